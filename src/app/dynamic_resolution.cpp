@@ -0,0 +1,56 @@
+#include <app/dynamic_resolution.hpp>
+
+namespace {
+    // Frames to wait after a change before measuring again, so the new buffers settle in.
+    constexpr auto COOLDOWN_FRAMES = uint32_t{30};
+    // Frames the smoothed time has to stay out of band before the scale changes.
+    constexpr auto SUSTAIN_FRAMES = uint32_t{10};
+    constexpr auto SMOOTHING = 0.1;
+    // Scale down above target * HIGH, scale up when the next step is predicted below target * LOW.
+    constexpr auto HIGH = 1.05;
+    constexpr auto LOW = 0.85;
+} // namespace
+
+auto DynamicResolution::update(double gpu_ms) -> bool {
+    smoothed_ms = smoothed_ms == 0.0 ? gpu_ms : smoothed_ms + (gpu_ms - smoothed_ms) * SMOOTHING;
+    if (++frames_since_change < COOLDOWN_FRAMES) {
+        return false;
+    }
+
+    // GPU time is roughly proportional to the pixel count, so to the square of the scale.
+    auto predicted_ms = [&](size_t index) {
+        auto const ratio = static_cast<double>(SCALES[index]) / static_cast<double>(SCALES[scale_index]);
+        return smoothed_ms * ratio * ratio;
+    };
+    auto new_index = scale_index;
+    if (smoothed_ms > target_ms * HIGH) {
+        // Drop straight to the largest scale that's predicted to fit.
+        while (new_index > 0 && predicted_ms(new_index) > target_ms) {
+            --new_index;
+        }
+    } else if (scale_index + 1 < SCALES.size() && predicted_ms(scale_index + 1) < target_ms * LOW) {
+        new_index = scale_index + 1;
+    }
+    if (new_index == scale_index) {
+        frames_out_of_band = 0;
+        return false;
+    }
+    if (++frames_out_of_band < SUSTAIN_FRAMES) {
+        return false;
+    }
+
+    smoothed_ms = predicted_ms(new_index);
+    scale_index = new_index;
+    frames_since_change = 0;
+    frames_out_of_band = 0;
+    return true;
+}
+
+auto DynamicResolution::reset() -> bool {
+    auto const changed = scale_index != SCALES.size() - 1;
+    scale_index = SCALES.size() - 1;
+    smoothed_ms = 0.0;
+    frames_since_change = 0;
+    frames_out_of_band = 0;
+    return changed;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Picks the viewport's render scale from measured GPU frame times. Scales are quantized, and
+// only change after the frame time stayed outside the target band for a while, because every
+// change reallocates the buffer passes.
+struct DynamicResolution {
+    static constexpr auto SCALES = std::array{0.25f, 0.375f, 0.5f, 0.625f, 0.75f, 0.875f, 1.0f};
+
+    bool enabled = false;
+    double target_ms = 1000.0 / 60.0;
+
+    // Feeds one frame's GPU time in. Returns true when the scale changed.
+    auto update(double gpu_ms) -> bool;
+    // Goes back to full resolution. Returns true when the scale changed.
+    auto reset() -> bool;
+    auto scale() const -> float { return SCALES[scale_index]; }
+
+  private:
+    size_t scale_index = SCALES.size() - 1;
+    double smoothed_ms{};
+    uint32_t frames_since_change{};
+    uint32_t frames_out_of_band{};
+};
@@ -0,0 +1,132 @@
+#include <app/gpu_profiler.hpp>
+
+#include <algorithm>
+#include <limits>
+
+void GpuProfiler::create(daxa::Device a_device, uint32_t a_frames_in_flight) {
+    device = std::move(a_device);
+    frames_in_flight = a_frames_in_flight;
+    current_slot = 0;
+    query_pool = device.create_timeline_query_pool({
+        .query_count = 2 * MAX_SCOPES * frames_in_flight,
+        .name = "gpu_profiler",
+    });
+    written.assign(frames_in_flight, {});
+}
+
+void GpuProfiler::clear_scopes() {
+    scope_names.clear();
+    ++generation;
+    // The frame times stay comparable, the per scope ones are indexed by the old scopes.
+    for (auto &frame : history) {
+        frame.scope_ms.clear();
+    }
+}
+
+auto GpuProfiler::scope(std::string const &name) -> uint32_t {
+    auto iter = std::find(scope_names.begin(), scope_names.end(), name);
+    if (iter != scope_names.end()) {
+        return static_cast<uint32_t>(iter - scope_names.begin());
+    }
+    if (scope_names.size() >= MAX_SCOPES) {
+        return INVALID_SCOPE;
+    }
+    scope_names.push_back(name);
+    return static_cast<uint32_t>(scope_names.size() - 1);
+}
+
+void GpuProfiler::begin_frame(uint32_t slot) {
+    current_slot = slot;
+}
+
+void GpuProfiler::begin(daxa::CommandRecorder &recorder, uint32_t scope_index) {
+    if (scope_index == INVALID_SCOPE || current_slot >= frames_in_flight) {
+        return;
+    }
+    auto const query_index = 2 * (current_slot * MAX_SCOPES + scope_index);
+    recorder.reset_timestamps({.query_pool = query_pool, .start_index = query_index, .count = 2});
+    recorder.write_timestamp({.query_pool = query_pool, .pipeline_stage = daxa::PipelineStageFlagBits::TOP_OF_PIPE, .query_index = query_index});
+}
+
+void GpuProfiler::end(daxa::CommandRecorder &recorder, uint32_t scope_index) {
+    if (scope_index == INVALID_SCOPE || current_slot >= frames_in_flight) {
+        return;
+    }
+    auto const query_index = 2 * (current_slot * MAX_SCOPES + scope_index);
+    recorder.write_timestamp({.query_pool = query_pool, .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE, .query_index = query_index + 1});
+    written[current_slot][scope_index] = generation;
+}
+
+auto GpuProfiler::wrap(std::string const &name, std::function<void(daxa::TaskInterface)> task) -> std::function<void(daxa::TaskInterface)> {
+    return [this, scope_index = scope(name), task = std::move(task)](daxa::TaskInterface ti) {
+        begin(ti.recorder, scope_index);
+        task(ti);
+        end(ti.recorder, scope_index);
+    };
+}
+
+void GpuProfiler::read_back(uint32_t slot) {
+    if (slot >= frames_in_flight) {
+        return;
+    }
+    auto const period_ns = static_cast<double>(device.properties().limits.timestamp_period);
+    auto frame = Frame{};
+    frame.scope_ms.assign(scope_names.size(), -1.0);
+    auto first_begin = std::numeric_limits<uint64_t>::max();
+    auto last_end = uint64_t{};
+    for (uint32_t scope_index = 0; scope_index < scope_names.size(); ++scope_index) {
+        if (written[slot][scope_index] != generation) {
+            continue;
+        }
+        auto const results = query_pool.get_query_results(2 * (slot * MAX_SCOPES + scope_index), 2);
+        // Value and availability, per query.
+        if (results.size() != 4 || results[1] == 0 || results[3] == 0 || results[2] < results[0]) {
+            continue;
+        }
+        frame.scope_ms[scope_index] = static_cast<double>(results[2] - results[0]) * period_ns * 1e-6;
+        first_begin = std::min(first_begin, results[0]);
+        last_end = std::max(last_end, results[2]);
+    }
+    if (last_end == 0) {
+        return;
+    }
+    frame.total_ms = static_cast<double>(last_end - first_begin) * period_ns * 1e-6;
+    // Only read once per write.
+    written[slot].fill(0);
+    history.push_back(std::move(frame));
+    if (history.size() > HISTORY_SIZE) {
+        history.pop_front();
+    }
+}
+
+auto GpuProfiler::timings() const -> GpuTimings {
+    auto result = GpuTimings{};
+    result.scopes.reserve(scope_names.size());
+    for (auto const &name : scope_names) {
+        result.scopes.push_back({.name = name});
+    }
+    auto sample_counts = std::vector<uint32_t>(scope_names.size());
+    result.frame_history_ms.reserve(history.size());
+    for (auto const &frame : history) {
+        result.frame_history_ms.push_back(frame.total_ms);
+        result.avg_frame_ms += frame.total_ms;
+        auto const count = std::min(frame.scope_ms.size(), result.scopes.size());
+        for (size_t i = 0; i < count; ++i) {
+            if (frame.scope_ms[i] < 0.0) {
+                continue;
+            }
+            result.scopes[i].avg_ms += frame.scope_ms[i];
+            result.scopes[i].max_ms = std::max(result.scopes[i].max_ms, frame.scope_ms[i]);
+            ++sample_counts[i];
+        }
+    }
+    if (!history.empty()) {
+        result.avg_frame_ms /= static_cast<double>(history.size());
+    }
+    for (size_t i = 0; i < result.scopes.size(); ++i) {
+        if (sample_counts[i] != 0) {
+            result.scopes[i].avg_ms /= static_cast<double>(sample_counts[i]);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <daxa/utils/task_graph.hpp>
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct GpuScopeTiming {
+    std::string name;
+    double avg_ms{};
+    double max_ms{};
+};
+
+struct GpuTimings {
+    // In the order the scopes were registered, which is the order their tasks were added in.
+    std::vector<GpuScopeTiming> scopes;
+    // Oldest first. From the first scope's begin to the last scope's end.
+    std::vector<double> frame_history_ms;
+    double avg_frame_ms{};
+};
+
+// Timestamps around named GPU scopes, one query pair per scope and frame in flight. Results are
+// read from the slot whose frame the swapchain acquire already waited for, so they're never
+// waited on and lag frames_in_flight frames behind.
+struct GpuProfiler {
+    static constexpr auto MAX_SCOPES = uint32_t{64};
+    static constexpr auto HISTORY_SIZE = size_t{120};
+    static constexpr auto INVALID_SCOPE = MAX_SCOPES;
+
+    // Recreates the query pool. The device must be idle.
+    void create(daxa::Device a_device, uint32_t a_frames_in_flight);
+    // Forgets the registered scopes, before the task graphs are recorded again.
+    void clear_scopes();
+    // Registers a scope at record time. Scopes with the same name share their queries, so every
+    // frame in flight's graph can register the same ones.
+    auto scope(std::string const &name) -> uint32_t;
+    // Sets the query slot the next executed graph writes to.
+    void begin_frame(uint32_t slot);
+    void begin(daxa::CommandRecorder &recorder, uint32_t scope_index);
+    void end(daxa::CommandRecorder &recorder, uint32_t scope_index);
+    // Returns a task that runs `task` between a begin and end of the scope `name`.
+    auto wrap(std::string const &name, std::function<void(daxa::TaskInterface)> task) -> std::function<void(daxa::TaskInterface)>;
+    // Reads the results of the frame that last used `slot`, if they're available.
+    void read_back(uint32_t slot);
+    auto timings() const -> GpuTimings;
+
+  private:
+    struct Frame {
+        // Indexed by scope, negative when the scope wasn't written that frame.
+        std::vector<double> scope_ms;
+        double total_ms{};
+    };
+
+    daxa::Device device{};
+    daxa::TimelineQueryPool query_pool{};
+    uint32_t frames_in_flight{};
+    uint32_t current_slot{};
+    std::vector<std::string> scope_names;
+    // Results are only read for scopes written since the last clear_scopes, per slot.
+    uint64_t generation = 1;
+    std::vector<std::array<uint64_t, MAX_SCOPES>> written;
+    std::deque<Frame> history;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ShaderPassLoadTimings {
+    std::string name;
+    // The pipeline was kept from the previous load, so nothing was compiled.
+    bool reused{};
+    // The SPIR-V came from the on-disk cache, so glslang didn't run.
+    bool spirv_cached{};
+    // The pass only renders when its inputs change.
+    bool frame_invariant{};
+    // Nothing the image pass reads depends on this pass, so it isn't rendered at all.
+    bool reachable = true;
+    // Channels with an input that the code never mentions, which were skipped.
+    uint32_t unused_channels{};
+    double texture_ms{};
+    double preprocess_ms{};
+    double parse_ms{};
+    double spirv_ms{};
+    double optimize_ms{};
+    double pipeline_ms{};
+    // Fragment stage size. The unoptimized count is only known when the optimizer ran for this load.
+    uint32_t spirv_instructions_unoptimized{};
+    uint32_t spirv_instructions{};
+};
+
+struct ShaderLoadTimings {
+    // Increments with every finished load, so the UI knows when to refresh.
+    uint64_t load_index{};
+    bool failed{};
+    // Wall clock time from the start of the load until its passes were ready, including the warm-up.
+    double total_ms{};
+    // Time spent drawing once with every new pipeline before the swap, so the first real frame doesn't hitch.
+    double warm_up_ms{};
+    // Wall clock time from queuing the decodes of the load's new textures on the thread pool until
+    // the last one was written to the staging arena. The passes' texture_ms only covers reading the
+    // files' headers and creating the images.
+    double texture_decode_ms{};
+    // Wall clock time recording and submitting the task graphs that upload them, at the swap.
+    double texture_upload_ms{};
+    std::vector<ShaderPassLoadTimings> passes;
+};
+
+// Memory of the buffer pass images, as of the last time the graph was recorded.
+struct BufferMemoryStats {
+    uint64_t allocated_bytes{};
+    // What allocating every buffer with a full mip chain would have cost on top.
+    uint64_t saved_bytes{};
+};
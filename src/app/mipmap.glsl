@@ -0,0 +1,58 @@
+#include <app/mipmap.inl>
+
+// Builds up to MIPMAP_LEVELS_PER_DISPATCH levels below `src` with a 2x2 box filter. Images are
+// accessed as 2D arrays so that cube maps work the same way, with one layer per z group.
+
+layout(local_size_x = MIPMAP_GROUP_SIZE, local_size_y = MIPMAP_GROUP_SIZE, local_size_z = 1) in;
+
+shared vec4 s_texels[MIPMAP_TILE_SIZE / 2][MIPMAP_TILE_SIZE / 2];
+
+void store_texel(uint level, uvec2 texel, uint layer, vec4 value) {
+    uvec2 level_size = max(uvec2(1), push.src_size >> (level + 1));
+    if (all(lessThan(texel, level_size))) {
+        imageStore(daxa_image2DArray(push.dst[level]), ivec3(texel, layer), value);
+    }
+}
+
+void main() {
+    uint layer = gl_WorkGroupID.z;
+    uvec2 local = gl_LocalInvocationID.xy;
+    ivec2 max_src = ivec2(push.src_size) - 1;
+
+    // The first level is read from the image. Every thread averages four quads, spread out
+    // over the tile so that neighboring threads store neighboring texels.
+    uvec2 tile = gl_WorkGroupID.xy * (MIPMAP_TILE_SIZE / 2);
+    for (uint i = 0; i < 4; ++i) {
+        uvec2 texel = local + uvec2(i & 1, i >> 1) * MIPMAP_GROUP_SIZE;
+        ivec2 src = ivec2(tile + texel) * 2;
+        vec4 sum = vec4(0);
+        for (uint j = 0; j < 4; ++j) {
+            ivec2 p = min(src + ivec2(j & 1, j >> 1), max_src);
+            sum += texelFetch(daxa_texture2DArray(push.src), ivec3(p, layer), 0);
+        }
+        vec4 value = sum * 0.25;
+        s_texels[texel.y][texel.x] = value;
+        store_texel(0, tile + texel, layer, value);
+    }
+
+    // The remaining levels are reduced in shared memory, halving the active threads each time.
+    uint size = MIPMAP_TILE_SIZE / 4;
+    for (uint level = 1; level < push.level_count; ++level) {
+        memoryBarrierShared();
+        barrier();
+        bool active = all(lessThan(local, uvec2(size)));
+        vec4 value = vec4(0);
+        if (active) {
+            uvec2 src = local * 2;
+            value = (s_texels[src.y][src.x] + s_texels[src.y][src.x + 1] +
+                     s_texels[src.y + 1][src.x] + s_texels[src.y + 1][src.x + 1]) *
+                    0.25;
+        }
+        barrier();
+        if (active) {
+            s_texels[local.y][local.x] = value;
+            store_texel(level, gl_WorkGroupID.xy * size + local, layer, value);
+        }
+        size /= 2;
+    }
+}
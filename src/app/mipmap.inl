@@ -0,0 +1,22 @@
+#pragma once
+
+#include <app/core.inl>
+
+// One 16x16 group reduces a 64x64 tile of the source level down to a single texel, which
+// makes for 6 levels per dispatch.
+#define MIPMAP_GROUP_SIZE 16
+#define MIPMAP_TILE_SIZE 64
+#define MIPMAP_LEVELS_PER_DISPATCH 6
+
+struct MipmapPush {
+    daxa_ImageViewId src;
+    daxa_ImageViewId dst[MIPMAP_LEVELS_PER_DISPATCH];
+    daxa_u32vec2 src_size;
+    daxa_u32 level_count;
+};
+
+#if DAXA_SHADER
+DAXA_DECL_PUSH_CONSTANT(MipmapPush, push)
+#else
+static_assert(sizeof(MipmapPush) <= 128);
+#endif
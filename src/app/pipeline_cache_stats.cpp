@@ -0,0 +1,68 @@
+#include <app/pipeline_cache_stats.hpp>
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <fstream>
+
+PipelineCacheStats::PipelineCacheStats(std::filesystem::path const &directory, daxa::DeviceProperties const &properties) {
+    // Same identity Vulkan uses to decide whether pipeline cache data is compatible.
+    auto uuid = std::string{};
+    for (auto byte : properties.pipeline_cache_uuid) {
+        uuid += fmt::format("{:02x}", static_cast<uint32_t>(byte));
+    }
+    file_path = directory / fmt::format("{:04x}-{:04x}-{:08x}-{}.txt", properties.vendor_id, properties.device_id, properties.driver_version, uuid);
+
+    auto ec = std::error_code{};
+    std::filesystem::create_directories(directory, ec);
+    auto file = std::ifstream{file_path};
+    auto key = uint64_t{};
+    auto time_ns = uint64_t{};
+    while (file >> std::hex >> key >> std::dec >> time_ns) {
+        cold_times_ns[key] = time_ns;
+    }
+}
+
+PipelineCacheStats::~PipelineCacheStats() {
+    save();
+}
+
+auto PipelineCacheStats::create_raster_pipeline(daxa::Device &device, SpirvCacheKey const &key, daxa::RasterPipelineInfo const &info) -> daxa::RasterPipeline {
+    auto const t0 = std::chrono::steady_clock::now();
+    auto pipeline = device.create_raster_pipeline(info);
+    auto const time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+
+    auto lock = std::lock_guard{mutex};
+    if (auto iter = cold_times_ns.find(key.hash); iter != cold_times_ns.end()) {
+        ++warm_creations;
+        warm_time_ns += time_ns;
+        saved_time_ns += iter->second > time_ns ? iter->second - time_ns : 0;
+    } else {
+        ++cold_creations;
+        cold_time_ns += time_ns;
+        cold_times_ns[key.hash] = time_ns;
+        dirty = true;
+    }
+    return pipeline;
+}
+
+void PipelineCacheStats::save() {
+    auto lock = std::lock_guard{mutex};
+    if (!dirty) {
+        return;
+    }
+    auto temp_path = file_path;
+    temp_path += ".tmp";
+    {
+        auto file = std::ofstream{temp_path};
+        if (!file.good()) {
+            return;
+        }
+        for (auto const &[key, time_ns] : cold_times_ns) {
+            file << fmt::format("{:016x} {}\n", key, time_ns);
+        }
+    }
+    auto ec = std::error_code{};
+    std::filesystem::rename(temp_path, file_path, ec);
+    dirty = static_cast<bool>(ec);
+}
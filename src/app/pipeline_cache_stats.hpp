@@ -0,0 +1,41 @@
+#pragma once
+
+#include <app/spirv_cache.hpp>
+
+#include <daxa/daxa.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+
+// Daxa creates pipelines without a VkPipelineCache, so the driver's own on-disk cache is what
+// makes re-creating a pipeline cheap. This keeps a per device/driver record of which pipelines
+// were created before and how long their first (cold) creation took, so that the time the
+// driver cache saves can be measured across runs.
+struct PipelineCacheStats {
+    PipelineCacheStats(std::filesystem::path const &directory, daxa::DeviceProperties const &properties);
+    ~PipelineCacheStats();
+
+    PipelineCacheStats(const PipelineCacheStats &) = delete;
+    PipelineCacheStats(PipelineCacheStats &&) = delete;
+    auto operator=(const PipelineCacheStats &) -> PipelineCacheStats & = delete;
+    auto operator=(PipelineCacheStats &&) -> PipelineCacheStats & = delete;
+
+    auto create_raster_pipeline(daxa::Device &device, SpirvCacheKey const &key, daxa::RasterPipelineInfo const &info) -> daxa::RasterPipeline;
+    void save();
+
+    std::atomic_uint64_t cold_creations{};
+    std::atomic_uint64_t warm_creations{};
+    std::atomic_uint64_t cold_time_ns{};
+    std::atomic_uint64_t warm_time_ns{};
+    // Sum of (recorded cold time - warm time) over all warm creations.
+    std::atomic_uint64_t saved_time_ns{};
+
+  private:
+    std::filesystem::path file_path;
+    std::unordered_map<uint64_t, uint64_t> cold_times_ns;
+    bool dirty = false;
+    std::mutex mutex;
+};
@@ -68,3 +68,30 @@ inline auto get_resource_dir() noexcept -> std::filesystem::path {
 }
 
 const std::filesystem::path resource_dir = get_resource_dir();
+
+inline auto get_cache_dir() noexcept -> std::filesystem::path {
+#if defined(_WIN32)
+    const char *local_app_data = getenv("LOCALAPPDATA");
+    if (local_app_data != nullptr) {
+        return std::filesystem::path(local_app_data) / "desktop-shadertoy";
+    }
+#elif defined(__APPLE__)
+    const char *home = getenv("HOME");
+    if (home != nullptr) {
+        return std::filesystem::path(home) / "Library/Caches/desktop-shadertoy";
+    }
+#else
+    const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+    if (xdg_cache_home != nullptr) {
+        return std::filesystem::path(xdg_cache_home) / "desktop-shadertoy";
+    }
+    const char *home = getenv("HOME");
+    if (home != nullptr) {
+        return std::filesystem::path(home) / ".cache/desktop-shadertoy";
+    }
+#endif
+    // The resource dir may be read-only (e.g. inside an AppImage), but it's the best we have.
+    return resource_dir / ".cache";
+}
+
+const std::filesystem::path cache_dir = get_cache_dir();
@@ -3,3 +3,4 @@
 #include <filesystem>
 
 extern const std::filesystem::path resource_dir;
+extern const std::filesystem::path cache_dir;
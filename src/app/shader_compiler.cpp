@@ -0,0 +1,305 @@
+#include <app/shader_compiler.hpp>
+
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+#include <spirv-tools/optimizer.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+namespace {
+    struct GlslangProcess {
+        GlslangProcess() { glslang::InitializeProcess(); }
+        ~GlslangProcess() { glslang::FinalizeProcess(); }
+
+        GlslangProcess(const GlslangProcess &) = delete;
+        GlslangProcess(GlslangProcess &&) = delete;
+        auto operator=(const GlslangProcess &) -> GlslangProcess & = delete;
+        auto operator=(GlslangProcess &&) -> GlslangProcess & = delete;
+    };
+
+    auto to_glslang_stage(ShaderStage stage) -> EShLanguage {
+        switch (stage) {
+        case ShaderStage::VERTEX: return EShLangVertex;
+        case ShaderStage::FRAGMENT: return EShLangFragment;
+        case ShaderStage::COMPUTE: return EShLangCompute;
+        }
+        return EShLangVertex;
+    }
+
+    auto to_daxa_stage_define(ShaderStage stage) -> char const * {
+        switch (stage) {
+        case ShaderStage::VERTEX: return "DAXA_SHADER_STAGE_VERTEX";
+        case ShaderStage::FRAGMENT: return "DAXA_SHADER_STAGE_FRAGMENT";
+        case ShaderStage::COMPUTE: return "DAXA_SHADER_STAGE_COMPUTE";
+        }
+        return "";
+    }
+
+    class ShaderIncluder : public glslang::TShader::Includer {
+      public:
+        explicit ShaderIncluder(GlslCompileInfo const &info) : info{info} {}
+
+        auto includeSystem(char const *header_name, char const * /*includer_name*/, size_t /*inclusion_depth*/) -> IncludeResult * override {
+            for (auto const *virtual_file : info.virtual_files) {
+                if (virtual_file->name == header_name) {
+                    auto contents = load_preprocessed(virtual_file->name, [&]() -> std::optional<std::string> {
+                        return virtual_file->contents;
+                    });
+                    return make_result(virtual_file->name, std::move(contents));
+                }
+            }
+            for (auto const &root_path : info.root_paths) {
+                if (auto *result = try_load(root_path / header_name)) {
+                    return result;
+                }
+            }
+            return nullptr;
+        }
+
+        auto includeLocal(char const *header_name, char const *includer_name, size_t inclusion_depth) -> IncludeResult * override {
+            auto includer_path = std::filesystem::path{includer_name};
+            if (includer_path.has_parent_path()) {
+                if (auto *result = try_load(includer_path.parent_path() / header_name)) {
+                    return result;
+                }
+            }
+            return includeSystem(header_name, includer_name, inclusion_depth);
+        }
+
+        void releaseInclude(IncludeResult *result) override {
+            if (result != nullptr) {
+                delete static_cast<std::shared_ptr<std::string const> *>(result->userData);
+                delete result;
+            }
+        }
+
+        auto load_preprocessed(std::string const &name, std::function<std::optional<std::string>()> const &load) -> std::shared_ptr<std::string const> {
+            auto load_and_preprocess = [&]() -> std::optional<std::string> {
+                auto contents = load();
+                if (contents && info.custom_preprocessor) {
+                    auto const t0 = std::chrono::steady_clock::now();
+                    info.custom_preprocessor(*contents, name);
+                    preprocess_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                }
+                return contents;
+            };
+            if (info.include_cache != nullptr) {
+                return info.include_cache->get_or_load(name, load_and_preprocess);
+            }
+            auto contents = load_and_preprocess();
+            return contents ? std::make_shared<std::string const>(std::move(*contents)) : nullptr;
+        }
+
+        double preprocess_ms{};
+
+      private:
+        auto try_load(std::filesystem::path const &path) -> IncludeResult * {
+            auto contents = load_preprocessed(path.string(), [&]() { return read_text_file(path); });
+            if (!contents) {
+                return nullptr;
+            }
+            return make_result(path.string(), std::move(contents));
+        }
+
+        static auto make_result(std::string const &name, std::shared_ptr<std::string const> contents) -> IncludeResult * {
+            auto const *data = contents->data();
+            auto const size = contents->size();
+            return new IncludeResult(name, data, size, new std::shared_ptr<std::string const>{std::move(contents)});
+        }
+
+        GlslCompileInfo const &info;
+    };
+} // namespace
+
+auto GlslIncludeCache::get_or_load(std::string const &key, std::function<std::optional<std::string>()> const &load) -> std::shared_ptr<std::string const> {
+    {
+        auto lock = std::lock_guard{mutex};
+        if (auto iter = files.find(key); iter != files.end()) {
+            return iter->second;
+        }
+    }
+    // Load outside of the lock. Two threads may race on the same file, but they produce the same contents.
+    auto contents = load();
+    auto entry = contents ? std::make_shared<std::string const>(std::move(*contents)) : nullptr;
+    auto lock = std::lock_guard{mutex};
+    return files.try_emplace(key, std::move(entry)).first->second;
+}
+
+auto read_text_file(std::filesystem::path const &path) -> std::optional<std::string> {
+    auto file = std::ifstream{path, std::ios::binary};
+    if (!file.good()) {
+        return std::nullopt;
+    }
+    auto buffer = std::stringstream{};
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+auto glslang_version_string() -> std::string {
+    auto const version = glslang::GetVersion();
+    return std::to_string(version.major) + "." + std::to_string(version.minor) + "." + std::to_string(version.patch) + version.flavor;
+}
+
+auto collect_include_files(std::filesystem::path const &source_path, std::vector<std::filesystem::path> const &root_paths) -> std::vector<std::pair<std::string, std::string>> {
+    auto result = std::vector<std::pair<std::string, std::string>>{};
+    auto visited = std::unordered_set<std::string>{};
+    auto pending = std::vector<std::filesystem::path>{source_path};
+    while (!pending.empty()) {
+        auto path = std::move(pending.back());
+        pending.pop_back();
+        auto key = path.lexically_normal().string();
+        if (!visited.insert(key).second) {
+            continue;
+        }
+        auto contents = read_text_file(path);
+        if (!contents) {
+            continue;
+        }
+        auto includes = std::vector<std::filesystem::path>{};
+        auto lines = std::istringstream{*contents};
+        for (auto line = std::string{}; std::getline(lines, line);) {
+            auto const directive = line.find_first_not_of(" \t");
+            if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0) {
+                continue;
+            }
+            auto const open = line.find_first_of("<\"", directive + 8);
+            auto const close = open == std::string::npos ? std::string::npos : line.find_first_of(">\"", open + 1);
+            if (close == std::string::npos) {
+                continue;
+            }
+            auto const header_name = line.substr(open + 1, close - open - 1);
+            // Same lookup order as the includer, files that aren't on disk are virtual or system headers.
+            auto candidates = std::vector<std::filesystem::path>{};
+            if (line[open] == '"') {
+                candidates.push_back(path.parent_path() / header_name);
+            }
+            for (auto const &root_path : root_paths) {
+                candidates.push_back(root_path / header_name);
+            }
+            for (auto const &candidate : candidates) {
+                if (std::filesystem::is_regular_file(candidate)) {
+                    includes.push_back(candidate);
+                    break;
+                }
+            }
+        }
+        result.emplace_back(std::move(key), std::move(*contents));
+        // Reversed, so the includes are visited in the order they appear.
+        pending.insert(pending.end(), includes.rbegin(), includes.rend());
+    }
+    return result;
+}
+
+auto count_spirv_instructions(std::vector<uint32_t> const &spirv) -> uint32_t {
+    // Skip the 5 word header. Every instruction stores its word count in the upper 16 bits of its first word.
+    auto count = uint32_t{};
+    auto i = size_t{5};
+    while (i < spirv.size()) {
+        auto const word_count = spirv[i] >> 16;
+        if (word_count == 0) {
+            break;
+        }
+        i += word_count;
+        ++count;
+    }
+    return count;
+}
+
+auto compile_glsl(GlslCompileInfo const &info) -> GlslCompileResult {
+    static auto const glslang_process = GlslangProcess{};
+
+    auto result = GlslCompileResult{};
+
+    auto includer = ShaderIncluder{info};
+    auto source = includer.load_preprocessed(info.source_path.string(), [&]() {
+        return info.source ? info.source : read_text_file(info.source_path);
+    });
+    if (!source) {
+        result.error = "Failed to open " + info.source_path.string();
+        return result;
+    }
+
+    auto preamble = std::string{};
+    preamble += "#extension GL_GOOGLE_include_directive : enable\n";
+    preamble += "#define DAXA_SHADER 1\n";
+    preamble += "#define DAXA_SHADERLANG DAXA_SHADERLANG_GLSL\n";
+    preamble += std::string{"#define DAXA_SHADER_STAGE "} + to_daxa_stage_define(info.stage) + "\n";
+    for (auto const &define : info.defines) {
+        preamble += "#define " + define.name + " " + define.value + "\n";
+    }
+
+    auto const glslang_stage = to_glslang_stage(info.stage);
+    auto const source_name = info.source_path.string();
+    auto const *source_ptr = source->c_str();
+    auto const *source_name_ptr = source_name.c_str();
+
+    glslang::TShader shader{glslang_stage};
+    shader.setStringsWithLengthsAndNames(&source_ptr, nullptr, &source_name_ptr, 1);
+    shader.setPreamble(preamble.c_str());
+    shader.setEntryPoint("main");
+    shader.setSourceEntryPoint("main");
+    shader.setEnvInput(glslang::EShSourceGlsl, glslang_stage, glslang::EShClientVulkan, 100);
+    shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_3);
+    shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_6);
+
+    auto const messages = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+    auto const parse_t0 = std::chrono::steady_clock::now();
+    auto const parse_preprocess_ms = includer.preprocess_ms;
+    auto finish_parse_timing = [&]() {
+        // Includes are preprocessed while glslang parses, so that time is taken out again.
+        auto const preprocess_during_parse_ms = includer.preprocess_ms - parse_preprocess_ms;
+        result.parse_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - parse_t0).count() - preprocess_during_parse_ms;
+        result.preprocess_ms = includer.preprocess_ms;
+    };
+    if (!shader.parse(GetDefaultResources(), 460, false, messages, includer)) {
+        finish_parse_timing();
+        result.error = std::string{shader.getInfoLog()} + shader.getInfoDebugLog();
+        return result;
+    }
+
+    glslang::TProgram program{};
+    program.addShader(&shader);
+    if (!program.link(messages)) {
+        finish_parse_timing();
+        result.error = std::string{program.getInfoLog()} + program.getInfoDebugLog();
+        return result;
+    }
+    finish_parse_timing();
+
+    auto spv_options = glslang::SpvOptions{};
+    spv_options.generateDebugInfo = false;
+    spv_options.disableOptimizer = true;
+    auto logger = spv::SpvBuildLogger{};
+    auto const spirv_t0 = std::chrono::steady_clock::now();
+    glslang::GlslangToSpv(*program.getIntermediate(glslang_stage), result.spirv, &logger, &spv_options);
+    result.spirv_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - spirv_t0).count();
+
+    if (info.optimization != SpirvOptimization::NONE && !result.spirv.empty()) {
+        // Optimize the module that was just generated. Of the unoptimized one, only its size is kept.
+        result.unoptimized_instruction_count = count_spirv_instructions(result.spirv);
+        auto optimizer = spvtools::Optimizer{SPV_ENV_VULKAN_1_3};
+        if (info.optimization == SpirvOptimization::SIZE) {
+            optimizer.RegisterSizePasses();
+        } else {
+            optimizer.RegisterPerformancePasses();
+        }
+        auto optimized = std::vector<uint32_t>{};
+        auto const optimize_t0 = std::chrono::steady_clock::now();
+        // On failure the unoptimized module is used, which is still valid.
+        if (optimizer.Run(result.spirv.data(), result.spirv.size(), &optimized)) {
+            result.spirv = std::move(optimized);
+        } else {
+            result.unoptimized_instruction_count = 0;
+        }
+        result.optimize_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - optimize_t0).count();
+    }
+    if (result.spirv.empty()) {
+        result.error = info.name + ": SPIR-V generation failed\n" + logger.getAllMessages();
+    }
+
+    return result;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <daxa/utils/pipeline_manager.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum struct ShaderStage {
+    VERTEX,
+    FRAGMENT,
+    COMPUTE,
+};
+
+// Preprocessed include files, shared by every compile of one project load. This way the
+// viewport preamble, the daxa headers and the common code are read and preprocessed once
+// per load instead of once per pass and stage. Files that weren't found are cached as null.
+struct GlslIncludeCache {
+    auto get_or_load(std::string const &key, std::function<std::optional<std::string>()> const &load) -> std::shared_ptr<std::string const>;
+
+  private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<std::string const>> files;
+};
+
+// Optimization presets for the spirv-opt passes run on the generated SPIR-V.
+enum struct SpirvOptimization {
+    NONE,
+    PERFORMANCE,
+    SIZE,
+};
+
+struct GlslCompileInfo {
+    std::filesystem::path source_path;
+    // Compiled instead of the file at `source_path` when set. `source_path` then only names the shader.
+    std::optional<std::string> source;
+    ShaderStage stage{};
+    std::vector<std::filesystem::path> root_paths;
+    // Virtual files are looked up by name before the root paths, like the daxa pipeline manager does.
+    std::vector<daxa::VirtualFileInfo const *> virtual_files;
+    std::vector<daxa::ShaderDefine> defines;
+    std::function<void(std::string &, std::filesystem::path const &)> custom_preprocessor;
+    std::string name;
+    GlslIncludeCache *include_cache = nullptr;
+    SpirvOptimization optimization = SpirvOptimization::NONE;
+};
+
+struct GlslCompileResult {
+    std::vector<uint32_t> spirv;
+    std::string error;
+    // Time spent in custom_preprocessor, in glslang's parse and link (without the former), and in SPIR-V generation.
+    double preprocess_ms{};
+    double parse_ms{};
+    double spirv_ms{};
+    // Only set when an optimization preset was used. Covers spirv-opt alone, spirv_ms the generation before it.
+    double optimize_ms{};
+    uint32_t unoptimized_instruction_count{};
+};
+
+// Compiles a GLSL file to SPIR-V with glslang. Safe to call from several threads at once.
+auto compile_glsl(GlslCompileInfo const &info) -> GlslCompileResult;
+
+// Identifies the glslang build, for cache keys of the SPIR-V it generates.
+auto glslang_version_string() -> std::string;
+// The file and every file it includes, transitively, that can be found on disk under the root
+// paths, as path and contents pairs in a stable order. Includes are followed regardless of the
+// preprocessor conditionals around them, so this is a superset of what a compile reads.
+auto collect_include_files(std::filesystem::path const &source_path, std::vector<std::filesystem::path> const &root_paths) -> std::vector<std::pair<std::string, std::string>>;
+auto read_text_file(std::filesystem::path const &path) -> std::optional<std::string>;
+auto count_spirv_instructions(std::vector<uint32_t> const &spirv) -> uint32_t;
@@ -0,0 +1,111 @@
+#include <app/spirv_cache.hpp>
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <fstream>
+#include <thread>
+
+namespace {
+    constexpr auto SPIRV_MAGIC = uint32_t{0x07230203};
+} // namespace
+
+SpirvCache::SpirvCache(std::filesystem::path a_directory, uint64_t a_max_size_bytes)
+    : directory{std::move(a_directory)}, max_size_bytes{a_max_size_bytes} {
+    auto ec = std::error_code{};
+    std::filesystem::create_directories(directory, ec);
+    for (auto const &entry : std::filesystem::directory_iterator{directory, ec}) {
+        if (entry.is_regular_file(ec) && entry.path().extension() == ".spv") {
+            size_bytes += entry.file_size(ec);
+        }
+    }
+}
+
+auto SpirvCache::entry_path(SpirvCacheKey const &key) const -> std::filesystem::path {
+    return directory / fmt::format("{:016x}.spv", key.hash);
+}
+
+auto SpirvCache::load(SpirvCacheKey const &key) -> std::optional<std::vector<uint32_t>> {
+    auto const path = entry_path(key);
+    auto file = std::ifstream{path, std::ios::binary | std::ios::ate};
+    if (!file.good()) {
+        ++misses;
+        return std::nullopt;
+    }
+    auto const size = static_cast<size_t>(file.tellg());
+    if (size == 0 || (size % sizeof(uint32_t)) != 0) {
+        ++misses;
+        return std::nullopt;
+    }
+    auto spirv = std::vector<uint32_t>(size / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(spirv.data()), static_cast<std::streamsize>(size));
+    if (!file.good() || spirv[0] != SPIRV_MAGIC) {
+        ++misses;
+        return std::nullopt;
+    }
+    // Touch the entry so that eviction sees it as recently used.
+    auto ec = std::error_code{};
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    ++hits;
+    return spirv;
+}
+
+void SpirvCache::store(SpirvCacheKey const &key, std::vector<uint32_t> const &spirv) {
+    auto const path = entry_path(key);
+    auto const size = spirv.size() * sizeof(uint32_t);
+
+    // Write to a temporary file first, so that concurrent readers never see a partial entry.
+    auto temp_path = path;
+    temp_path += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        auto file = std::ofstream{temp_path, std::ios::binary};
+        if (!file.good()) {
+            return;
+        }
+        file.write(reinterpret_cast<char const *>(spirv.data()), static_cast<std::streamsize>(size));
+    }
+    auto ec = std::error_code{};
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        return;
+    }
+
+    auto lock = std::lock_guard{mutex};
+    size_bytes += size;
+    if (size_bytes > max_size_bytes) {
+        evict();
+    }
+}
+
+void SpirvCache::evict() {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        uint64_t size;
+    };
+    auto entries = std::vector<Entry>{};
+    auto ec = std::error_code{};
+    size_bytes = 0;
+    for (auto const &dir_entry : std::filesystem::directory_iterator{directory, ec}) {
+        if (!dir_entry.is_regular_file(ec) || dir_entry.path().extension() != ".spv") {
+            continue;
+        }
+        auto const entry_size = dir_entry.file_size(ec);
+        entries.push_back({dir_entry.path(), dir_entry.last_write_time(ec), entry_size});
+        size_bytes += entry_size;
+    }
+    std::sort(entries.begin(), entries.end(), [](Entry const &a, Entry const &b) { return a.time < b.time; });
+
+    // Evict down to 3/4 of the budget, so we don't rescan the directory on every store.
+    auto const target_size = max_size_bytes - max_size_bytes / 4;
+    for (auto const &entry : entries) {
+        if (size_bytes <= target_size) {
+            break;
+        }
+        if (std::filesystem::remove(entry.path, ec)) {
+            size_bytes -= entry.size;
+            ++evictions;
+        }
+    }
+}
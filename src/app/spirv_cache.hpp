@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// 64-bit FNV-1a, so keys stay stable across runs, compilers and platforms.
+struct SpirvCacheKey {
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    void append(std::string_view str) {
+        for (auto c : str) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x100000001b3ull;
+        }
+        // Mix in the length too, so that ("ab", "c") and ("a", "bc") don't collide.
+        auto size = static_cast<uint64_t>(str.size());
+        for (uint32_t i = 0; i < 8; ++i) {
+            hash ^= (size >> (i * 8)) & 0xff;
+            hash *= 0x100000001b3ull;
+        }
+    }
+};
+
+// Content-addressed on-disk cache of compiled SPIR-V modules. Entries are evicted least
+// recently used first once the directory grows past `max_size_bytes`.
+struct SpirvCache {
+    explicit SpirvCache(std::filesystem::path a_directory, uint64_t a_max_size_bytes = 256ull * 1024 * 1024);
+
+    auto load(SpirvCacheKey const &key) -> std::optional<std::vector<uint32_t>>;
+    void store(SpirvCacheKey const &key, std::vector<uint32_t> const &spirv);
+
+    std::atomic_uint64_t hits{};
+    std::atomic_uint64_t misses{};
+    std::atomic_uint64_t evictions{};
+
+  private:
+    auto entry_path(SpirvCacheKey const &key) const -> std::filesystem::path;
+    void evict();
+
+    std::filesystem::path directory;
+    uint64_t max_size_bytes{};
+    uint64_t size_bytes{};
+    std::mutex mutex;
+};
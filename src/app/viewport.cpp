@@ -1,17 +1,28 @@
 #define DAXA_REMOVE_DEPRECATED 0
 
 #include <app/viewport.hpp>
+#include <app/mipmap.inl>
 #include <app/resources.hpp>
+#include <app/shader_compiler.hpp>
 
 #include <GLFW/glfw3.h>
 #include <daxa/c/core.h>
 #include <daxa/utils/task_graph_types.hpp>
 #include <stb_image.h>
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <random>
+#include <string_view>
 
 #include <fstream>
 
@@ -29,7 +40,24 @@ enum struct ShaderToyWrap {
 
 #define MAX_MIP 9
 
-auto do_blit(daxa::TaskInterface ti, daxa::ImageId lower_mip, daxa::ImageId higher_mip, uint32_t mip) {
+constexpr auto DEFAULT_CUBE_SIZE = uint32_t{1024};
+constexpr auto MIN_CUBE_SIZE = uint32_t{16};
+constexpr auto MAX_CUBE_SIZE = uint32_t{4096};
+// The load timings log is moved aside once it grows past this, keeping one previous file.
+constexpr auto MAX_LOAD_TIMINGS_LOG_SIZE = uintmax_t{4} * 1024 * 1024;
+
+// Down to 1x1, but never more than MAX_MIP levels.
+auto mip_level_count(bool needs_mipmap, uint32_t width, uint32_t height) -> uint32_t {
+    if (!needs_mipmap) {
+        return 1;
+    }
+    return std::min<uint32_t>(MAX_MIP, static_cast<uint32_t>(std::bit_width(std::max(width, height))));
+}
+
+// Slots are kept 256 byte aligned, which satisfies every buffer offset alignment we copy from.
+constexpr auto UPLOAD_RING_SLOT_STRIDE = (sizeof(UploadRingSlot) + 255) & ~size_t{255};
+
+auto do_blit(daxa::TaskInterface ti, daxa::ImageId lower_mip, daxa::ImageId higher_mip, uint32_t mip, uint32_t layer_count) {
     auto image_size = ti.device.image_info(lower_mip).value().size;
     auto mip_size = std::array<int32_t, 3>{
         std::max<int32_t>(1, static_cast<int32_t>(image_size.x / (1u << mip))),
@@ -47,59 +75,50 @@ auto do_blit(daxa::TaskInterface ti, daxa::ImageId lower_mip, daxa::ImageId high
         .src_slice = {
             .mip_level = mip,
             .base_array_layer = 0,
-            .layer_count = 1,
+            .layer_count = layer_count,
         },
         .src_offsets = {{{0, 0, 0}, {mip_size[0], mip_size[1], mip_size[2]}}},
         .dst_slice = {
             .mip_level = mip + 1,
             .base_array_layer = 0,
-            .layer_count = 1,
+            .layer_count = layer_count,
         },
         .dst_offsets = {{{0, 0, 0}, {next_mip_size[0], next_mip_size[1], next_mip_size[2]}}},
         .filter = daxa::Filter::LINEAR,
     });
 }
 
-void GpuInputUploadTransferTask_record(daxa::Device &device, daxa::CommandRecorder &cmd_list, daxa::BufferId input_buffer, GpuInput &gpu_input) {
-    auto staging_input_buffer = device.create_buffer({
-        .size = sizeof(GpuInput),
-        .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-        .name = "staging_input_buffer",
-    });
-    cmd_list.destroy_buffer_deferred(staging_input_buffer);
-    auto *buffer_ptr = device.buffer_host_address_as<GpuInput>(staging_input_buffer).value();
-    *buffer_ptr = gpu_input;
-    cmd_list.copy_buffer_to_buffer({
-        .src_buffer = staging_input_buffer,
-        .dst_buffer = input_buffer,
-        .size = sizeof(GpuInput),
-    });
-}
-
-void ShaderToyTask_record(std::shared_ptr<daxa::RasterPipeline> const &pipeline, daxa::CommandRecorder &cmd_list, BDA input_buffer_ptr, InputImages const &images, daxa::ImageId render_image, daxa_u32vec2 size) {
+// With `flip_y`, fragCoord is made relative to the bottom left of the render area, like Shadertoy's.
+// Otherwise the image is rendered upside down, and it's up to the consumer to flip it.
+void ShaderToyTask_record(std::shared_ptr<daxa::RasterPipeline> const &pipeline, daxa::CommandRecorder &cmd_list, BDA input_buffer_ptr, InputImages const &images, daxa::ImageId render_image, daxa_u32vec2 size, daxa_i32vec2 offset = {0, 0}, bool flip_y = false) {
     if (!pipeline || !pipeline->is_valid()) {
         return;
     }
     auto renderpass = std::move(cmd_list).begin_renderpass({
         .color_attachments = {{.image_view = render_image.default_view(), .load_op = daxa::AttachmentLoadOp::LOAD, .clear_value = std::array<daxa_f32, 4>{0.5f, 0.5f, 0.5f, 1.0f}}},
-        .render_area = {.x = 0, .y = 0, .width = size.x, .height = size.y},
+        .render_area = {.x = offset.x, .y = offset.y, .width = size.x, .height = size.y},
     });
     renderpass.set_pipeline(*pipeline);
     renderpass.push_constant(ShaderToyPush{
         .gpu_input = input_buffer_ptr,
         .input_images = images,
+        .frag_coord_offset = {
+            static_cast<daxa_f32>(-offset.x),
+            flip_y ? static_cast<daxa_f32>(offset.y) + static_cast<daxa_f32>(size.y) : static_cast<daxa_f32>(-offset.y),
+        },
+        .frag_coord_y_scale = flip_y ? -1.0f : 1.0f,
     });
     renderpass.draw({.vertex_count = 3});
     cmd_list = std::move(renderpass).end_renderpass();
 }
 
-void ShaderToyCubeTask_record(std::shared_ptr<daxa::RasterPipeline> const &pipeline, daxa::CommandRecorder &cmd_list, BDA input_buffer_ptr, InputImages const &images, daxa::ImageViewId cube_face, daxa_u32 i) {
+void ShaderToyCubeTask_record(std::shared_ptr<daxa::RasterPipeline> const &pipeline, daxa::CommandRecorder &cmd_list, BDA input_buffer_ptr, InputImages const &images, daxa::ImageViewId cube_face, daxa_u32 size, daxa_u32 i) {
     if (!pipeline) {
         return;
     }
     auto renderpass = std::move(cmd_list).begin_renderpass({
         .color_attachments = {{.image_view = cube_face, .load_op = daxa::AttachmentLoadOp::LOAD, .clear_value = std::array<daxa_f32, 4>{0.5f, 0.5f, 0.5f, 1.0f}}},
-        .render_area = {.x = 0, .y = 0, .width = 1024, .height = 1024},
+        .render_area = {.x = 0, .y = 0, .width = size, .height = size},
     });
     renderpass.set_pipeline(*pipeline);
     renderpass.push_constant(ShaderToyPush{
@@ -150,57 +169,495 @@ void replace_all(std::string &s, std::string const &toReplace, std::string const
     s.swap(buf);
 }
 
+namespace {
+    struct IdentifierRewrite {
+        std::string_view from;
+        std::string_view to;
+        bool user_code_only;
+    };
+
+    constexpr auto IDENTIFIER_REWRITES = std::array{
+        IdentifierRewrite{"sampler2D", "CombinedImageSampler2D", false},
+        IdentifierRewrite{"sampler3D", "CombinedImageSampler3D", false},
+        IdentifierRewrite{"samplerCube", "CombinedImageSamplerCube", false},
+        // These are functions/names that may be used in shadertoy code, however
+        // they're reserved names or functions in this dialect of Vulkan GLSL.
+        // Here, we'll replace them with some working names
+        IdentifierRewrite{"textureCube", "ds_TextureCube", true},
+        IdentifierRewrite{"packUnorm2x16", "ds_PackUnorm2x16", true},
+        IdentifierRewrite{"packSnorm2x16", "ds_PackSnorm2x16", true},
+        IdentifierRewrite{"packUnorm4x8", "ds_PackUnorm4x8", true},
+        IdentifierRewrite{"packSnorm4x8", "ds_PackSnorm4x8", true},
+        IdentifierRewrite{"unpackUnorm2x16", "ds_UnpackUnorm2x16", true},
+        IdentifierRewrite{"unpackSnorm2x16", "ds_UnpackSnorm2x16", true},
+        IdentifierRewrite{"unpackUnorm4x8", "ds_UnpackUnorm4x8", true},
+        IdentifierRewrite{"unpackSnorm4x8", "ds_UnpackSnorm4x8", true},
+        IdentifierRewrite{"buffer", "ds_Buffer", true},
+        IdentifierRewrite{"sampler", "ds_Sampler", true},
+    };
+
+    auto find_identifier_rewrite(std::string_view identifier, bool is_standard_code) -> IdentifierRewrite const * {
+        // Every entry starts with one of these, which rejects almost all identifiers right away.
+        switch (identifier[0]) {
+        case 's': case 't': case 'p': case 'u': case 'b': break;
+        default: return nullptr;
+        }
+        for (auto const &rewrite : IDENTIFIER_REWRITES) {
+            if (rewrite.from == identifier && (!rewrite.user_code_only || !is_standard_code)) {
+                return &rewrite;
+            }
+        }
+        return nullptr;
+    }
+
+    // The GpuInput fields that change from frame to frame without the project doing anything,
+    // with the global viewport.glsl copies them into and their member index.
+    struct FrameInput {
+        std::string_view global;
+        uint32_t member;
+    };
+    constexpr auto FRAME_INPUTS = std::array{
+        FrameInput{"iTime", 1},
+        FrameInput{"iTimeDelta", 2},
+        FrameInput{"iFrameRate", 3},
+        FrameInput{"iFrame", 4},
+        FrameInput{"iChannelTime", 5},
+        FrameInput{"iMouse", 7},
+        FrameInput{"iDate", 8},
+    };
+
+    // Whether a fragment module reads any of FRAME_INPUTS. main() stores every field into its global, so
+    // only loads of a global count. When the optimizer removed a global, the remaining reads go
+    // straight to the GpuInput member instead. Modules without names are assumed to read everything.
+    auto reads_frame_inputs(std::vector<uint32_t> const &spirv) -> bool {
+        constexpr auto OP_NAME = 5u;
+        constexpr auto OP_TYPE_STRUCT = 30u;
+        constexpr auto OP_TYPE_POINTER = 32u;
+        constexpr auto OP_CONSTANT = 43u;
+        constexpr auto OP_VARIABLE = 59u;
+        constexpr auto OP_LOAD = 61u;
+        constexpr auto OP_COPY_MEMORY = 63u;
+        constexpr auto OP_ACCESS_CHAIN = 65u;
+        constexpr auto OP_IN_BOUNDS_ACCESS_CHAIN = 66u;
+        constexpr auto OP_PTR_ACCESS_CHAIN = 67u;
+        constexpr auto OP_IN_BOUNDS_PTR_ACCESS_CHAIN = 70u;
+        constexpr auto STORAGE_CLASS_PRIVATE = 6u;
+
+        auto names = std::unordered_map<uint32_t, std::string_view>{};
+        auto pointee_types = std::unordered_map<uint32_t, uint32_t>{};
+        auto struct_members = std::unordered_map<uint32_t, std::vector<uint32_t>>{};
+        auto constants = std::unordered_map<uint32_t, uint32_t>{};
+        auto private_variables = std::unordered_map<std::string_view, uint32_t>{};
+        // Type of, and variable behind, every pointer.
+        auto pointer_types = std::unordered_map<uint32_t, uint32_t>{};
+        auto pointer_roots = std::unordered_map<uint32_t, uint32_t>{};
+        auto loaded_roots = std::unordered_set<uint32_t>{};
+        auto gpu_input_members = std::unordered_set<uint32_t>{};
+        auto gpu_input_type = std::optional<uint32_t>{};
+
+        auto const root_of = [&](uint32_t id) {
+            auto iter = pointer_roots.find(id);
+            return iter != pointer_roots.end() ? iter->second : id;
+        };
+
+        auto i = size_t{5};
+        while (i < spirv.size()) {
+            auto const word_count = spirv[i] >> 16;
+            auto const opcode = spirv[i] & 0xffff;
+            if (word_count == 0 || i + word_count > spirv.size()) {
+                return true;
+            }
+            auto const *words = spirv.data() + i;
+            switch (opcode) {
+            case OP_NAME: {
+                auto const *chars = reinterpret_cast<char const *>(words + 2);
+                auto const name = std::string_view{chars, strnlen(chars, (word_count - 2) * sizeof(uint32_t))};
+                names[words[1]] = name;
+                if (name == "GpuInput") {
+                    gpu_input_type = words[1];
+                }
+            } break;
+            case OP_TYPE_STRUCT: struct_members[words[1]] = std::vector<uint32_t>(words + 2, words + word_count); break;
+            case OP_TYPE_POINTER: pointee_types[words[1]] = words[3]; break;
+            case OP_CONSTANT: constants[words[2]] = words[3]; break;
+            case OP_VARIABLE:
+                pointer_types[words[2]] = words[1];
+                if (words[3] == STORAGE_CLASS_PRIVATE) {
+                    if (auto iter = names.find(words[2]); iter != names.end()) {
+                        private_variables[iter->second] = words[2];
+                    }
+                }
+                break;
+            case OP_LOAD:
+                // Loading the GpuInput reference out of the push constant yields a pointer, so keep its type.
+                pointer_types[words[2]] = words[1];
+                loaded_roots.insert(root_of(words[3]));
+                break;
+            case OP_COPY_MEMORY: loaded_roots.insert(root_of(words[2])); break;
+            case OP_ACCESS_CHAIN:
+            case OP_IN_BOUNDS_ACCESS_CHAIN:
+            case OP_PTR_ACCESS_CHAIN:
+            case OP_IN_BOUNDS_PTR_ACCESS_CHAIN: {
+                auto const base = words[3];
+                pointer_types[words[2]] = words[1];
+                pointer_roots[words[2]] = root_of(base);
+                // The ptr variants have an element index before the member indices.
+                auto const first_index = (opcode == OP_PTR_ACCESS_CHAIN || opcode == OP_IN_BOUNDS_PTR_ACCESS_CHAIN) ? 5u : 4u;
+                // Walk down the struct members until GpuInput is reached, e.g. through daxa's buffer pointer block.
+                auto const base_type = pointer_types.find(base);
+                if (!gpu_input_type || base_type == pointer_types.end()) {
+                    break;
+                }
+                auto type = pointee_types[base_type->second];
+                for (auto index = first_index; index < word_count; ++index) {
+                    auto const constant = constants.find(words[index]);
+                    if (constant == constants.end()) {
+                        break;
+                    }
+                    if (type == *gpu_input_type) {
+                        gpu_input_members.insert(constant->second);
+                        break;
+                    }
+                    auto const members = struct_members.find(type);
+                    if (members == struct_members.end() || constant->second >= members->second.size()) {
+                        break;
+                    }
+                    type = members->second[constant->second];
+                }
+            } break;
+            default: break;
+            }
+            i += word_count;
+        }
+
+        if (names.empty()) {
+            return true;
+        }
+        for (auto const &input : FRAME_INPUTS) {
+            if (auto iter = private_variables.find(input.global); iter != private_variables.end()) {
+                if (loaded_roots.contains(iter->second)) {
+                    return true;
+                }
+            } else if (!gpu_input_type || gpu_input_members.contains(input.member)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Cube pass formats a project can pick. All of them can be rendered to and written by the mip map shader.
+    auto parse_cube_format(std::string_view name) -> std::optional<daxa::Format> {
+        if (name == "rgba8") {
+            return daxa::Format::R8G8B8A8_UNORM;
+        }
+        if (name == "rgba16f") {
+            return daxa::Format::R16G16B16A16_SFLOAT;
+        }
+        if (name == "rgba32f") {
+            return daxa::Format::R32G32B32A32_SFLOAT;
+        }
+        return std::nullopt;
+    }
+
+    auto is_identifier_start(char c) -> bool {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    auto is_identifier_char(char c) -> bool {
+        return is_identifier_start(c) || (c >= '0' && c <= '9');
+    }
+
+    // Bit N is set when `code` mentions iChannelN. Anything like iChannel##n sets all of them.
+    auto referenced_channels(std::string_view code) -> uint32_t {
+        constexpr auto NAME = std::string_view{"iChannel"};
+        auto mask = uint32_t{};
+        for (auto pos = code.find(NAME); pos != std::string_view::npos; pos = code.find(NAME, pos + NAME.size())) {
+            if (pos > 0 && is_identifier_char(code[pos - 1])) {
+                continue;
+            }
+            auto const end = pos + NAME.size();
+            if (end < code.size() && code[end] >= '0' && code[end] <= '3' && (end + 1 == code.size() || !is_identifier_char(code[end + 1]))) {
+                mask |= 1u << (code[end] - '0');
+            } else if (end == code.size() || !is_identifier_char(code[end])) {
+                mask |= 0xfu;
+            }
+        }
+        return mask;
+    }
+
+    auto shader_root_paths(std::filesystem::path const &shader_include_dir) -> std::vector<std::filesystem::path> {
+        return {shader_include_dir, DAXA_SHADER_INCLUDE_DIR, "src"};
+    }
+
+    // One input of a pass, parsed once up front. The textures of all passes are then staged from
+    // these before any pass is built from them.
+    struct ParsedPassInput {
+        nlohmann::json *json;
+        std::string type;
+        uint32_t channel{};
+        // With the quotes removed.
+        std::string id;
+        // False when the pass' code never mentions the channel.
+        bool used{};
+        // TEXTURE, CUBE_TEXTURE or VOLUME_TEXTURE for inputs backed by a loaded texture, NONE otherwise.
+        ShaderPassInputType texture_type = ShaderPassInputType::NONE;
+        // The loaded_textures key: the file as given in the project, or the volume's id. Empty when
+        // the input doesn't name a file.
+        std::string texture_key;
+    };
+
+    auto parse_pass_inputs(nlohmann::json &inputs, uint32_t used_channels, std::unordered_map<std::string, ShaderPassInput> const &id_map) -> std::vector<ParsedPassInput> {
+        auto result = std::vector<ParsedPassInput>{};
+        for (auto &input : inputs) {
+            auto parsed = ParsedPassInput{.json = &input};
+            if (input.contains("type")) {
+                parsed.type = input["type"];
+            } else if (input.contains("ctype")) {
+                parsed.type = input["ctype"];
+            } else {
+                // 😐
+                continue;
+            }
+            // Skip unsupported input types
+            auto const &type = parsed.type;
+            if (type != "image" && type != "buffer" && type != "cubemap" && type != "texture" && type != "keyboard" && type != "volume") {
+                continue;
+            }
+            parsed.channel = uint32_t{input["channel"]};
+            parsed.used = parsed.channel >= 4 || (used_channels & (1u << parsed.channel)) != 0;
+            parsed.id = nlohmann::to_string(input["id"]);
+            replace_all(parsed.id, "\"", "");
+            if (type == "volume") {
+                parsed.texture_type = ShaderPassInputType::VOLUME_TEXTURE;
+                parsed.texture_key = parsed.id;
+            } else if (type == "texture" || (type == "cubemap" && !id_map.contains(parsed.id))) {
+                parsed.texture_type = type == "texture" ? ShaderPassInputType::TEXTURE : ShaderPassInputType::CUBE_TEXTURE;
+                if (input.contains("filepath")) {
+                    parsed.texture_key = std::string{input["filepath"]};
+                } else if (input.contains("src")) {
+                    parsed.texture_key = std::string{input["src"]};
+                }
+            }
+            result.push_back(std::move(parsed));
+        }
+        return result;
+    }
+
+    // A cube texture is six files: the given one for face 0, and ones suffixed _1 to _5 next to it.
+    auto cube_face_paths(std::string const &path) -> std::array<std::string, 6> {
+        auto result = std::array<std::string, 6>{};
+        result[0] = path;
+        auto const base_path = std::filesystem::path(path);
+        for (uint32_t i = 1; i < 6; ++i) {
+            result[i] = (base_path.parent_path() / (base_path.stem().string() + "_" + std::to_string(i) + base_path.extension().string())).string();
+        }
+        return result;
+    }
+
+    auto staged_size_bytes(DecodedImage const &image) -> size_t {
+        return static_cast<size_t>(image.size.x) * image.size.y * image.size.z * image.pixel_size_bytes;
+    }
+
+    // Copy offsets have to be a multiple of the texel size, which is at most 16 bytes.
+    auto staged_stride_bytes(DecodedImage const &image) -> size_t {
+        return (staged_size_bytes(image) + 15) & ~size_t{15};
+    }
+
+    // The size and format a texture will be decoded to, from the file's header alone.
+    auto probe_texture(std::string const &path, TextureSourceKind kind) -> DecodedImage {
+        auto result = DecodedImage{};
+        if (kind == TextureSourceKind::VOLUME) {
+            auto const is_gray = path == "4sfGRr";
+            result.size = {32, 32, 32};
+            result.format = is_gray ? daxa::Format::R8_UNORM : daxa::Format::R8G8B8A8_UNORM;
+            result.pixel_size_bytes = is_gray ? 1 : 4;
+            return result;
+        }
+        int32_t size_x = 0;
+        int32_t size_y = 0;
+        int32_t channel_n = 0;
+        if (stbi_info(path.c_str(), &size_x, &size_y, &channel_n) != 0) {
+            result.size = {static_cast<uint32_t>(size_x), static_cast<uint32_t>(size_y), 1};
+            result.format = daxa::Format::R8G8B8A8_UNORM;
+            return result;
+        }
+        if (kind == TextureSourceKind::CUBE_FACE) {
+            return result;
+        }
+        // check if the file exists at all, allowing people to load a file to binary data
+        auto file = std::ifstream{path, std::ios::binary};
+        if (!file.good()) {
+            return result;
+        }
+        auto size = std::filesystem::file_size(path);
+        result.pixel_size_bytes = 16;
+        size = (size + result.pixel_size_bytes - 1) & ~static_cast<uintmax_t>(result.pixel_size_bytes - 1);
+        result.size.x = static_cast<uint32_t>(std::min<uintmax_t>(size / result.pixel_size_bytes, 1024));
+        result.size.y = static_cast<uint32_t>((size / result.pixel_size_bytes + 1023) / 1024);
+        result.size.z = 1;
+        result.format = daxa::Format::R32G32B32A32_UINT;
+        return result;
+    }
+
+    // Writes the texture's pixels to `dst`, laid out the way probe_texture() said. Safe to call from
+    // several threads at once, the flip flag is set per thread.
+    auto decode_texture(std::string const &path, TextureSourceKind kind, DecodedImage const &image, uint8_t *dst) -> bool {
+        auto const size_bytes = staged_size_bytes(image);
+        if (kind == TextureSourceKind::VOLUME) {
+            auto rng = std::mt19937_64(std::hash<std::string>{}(path));
+            auto dist = std::uniform_int_distribution<std::mt19937::result_type>(0, 255);
+            for (size_t i = 0; i < size_bytes; ++i) {
+                dst[i] = static_cast<uint8_t>(dist(rng) & 0xff);
+            }
+            return true;
+        }
+        if (image.format == daxa::Format::R32G32B32A32_UINT) {
+            auto file = std::ifstream{path, std::ios::binary};
+            memset(dst, 0, size_bytes);
+            file.read(reinterpret_cast<char *>(dst), static_cast<std::streamsize>(size_bytes));
+            return true;
+        }
+        int32_t size_x = 0;
+        int32_t size_y = 0;
+        int32_t channel_n = 0;
+        // Unlike 2D textures, cube faces are uploaded the way they are stored.
+        stbi_set_flip_vertically_on_load_thread(kind == TextureSourceKind::CUBE_FACE ? 0 : 1);
+        auto *stb_data = stbi_load(path.c_str(), &size_x, &size_y, &channel_n, 4);
+        if (stb_data == nullptr) {
+            return false;
+        }
+        // The file may have changed since its header was read.
+        auto const matches = static_cast<uint32_t>(size_x) == image.size.x && static_cast<uint32_t>(size_y) == image.size.y;
+        if (matches) {
+            memcpy(dst, stb_data, size_bytes);
+        }
+        stbi_image_free(stb_data);
+        return matches;
+    }
+
+    // Calls `on_exit` when it goes out of scope, unless it was dismissed before.
+    template <typename F>
+    struct ScopeGuard {
+        F on_exit;
+        bool dismissed = false;
+
+        ~ScopeGuard() {
+            if (!dismissed) {
+                on_exit();
+            }
+        }
+    };
+} // namespace
+
+// Some exported projects have their newlines escaped twice, which leaves the whole pass on one
+// line. Only those are un-escaped, so a "\n" in a string or comment of normal code stays as is.
+void unescape_shader_code(std::string &code) {
+    if (code.find('\n') == std::string::npos) {
+        replace_all(code, "\\n", "\n");
+    }
+}
+
 void shader_preprocess(std::string &contents, std::filesystem::path const &path) {
-    std::string line = {};
-    std::stringstream file_ss{contents};
-    std::stringstream result_ss = {};
     bool is_standard_code =
         path.filename() == "daxa.glsl" ||
         path.filename() == "daxa.inl" ||
         path.filename() == "task_graph.inl" ||
         path.filename() == "viewport.glsl" ||
         path.filename() == "viewport.inl";
-    while (std::getline(file_ss, line)) {
-        replace_all(line, "sampler2D", "CombinedImageSampler2D", true);
-        replace_all(line, "sampler3D", "CombinedImageSampler3D", true);
-        replace_all(line, "samplerCube", "CombinedImageSamplerCube", true);
-        if (!is_standard_code) {
-            // These are functions/names that may be used in shadertoy code, however
-            // they're reserved names or functions in this dialect of Vulkan GLSL.
-            // Here, we'll replace them with some working names
-            replace_all(line, "textureCube", "ds_TextureCube", true);
-            replace_all(line, "packUnorm2x16", "ds_PackUnorm2x16", true);
-            replace_all(line, "packSnorm2x16", "ds_PackSnorm2x16", true);
-            replace_all(line, "packUnorm4x8", "ds_PackUnorm4x8", true);
-            replace_all(line, "packSnorm4x8", "ds_PackSnorm4x8", true);
-            replace_all(line, "unpackUnorm2x16", "ds_UnpackUnorm2x16", true);
-            replace_all(line, "unpackSnorm2x16", "ds_UnpackSnorm2x16", true);
-            replace_all(line, "unpackUnorm4x8", "ds_UnpackUnorm4x8", true);
-            replace_all(line, "unpackSnorm4x8", "ds_UnpackSnorm4x8", true);
-            replace_all(line, "buffer", "ds_Buffer", true);
-            replace_all(line, "sampler", "ds_Sampler", true);
-        }
-        result_ss << line << "\n";
-    }
-    contents = result_ss.str();
+
+    // One linear scan over the source. Untouched text is copied in runs, and only whole
+    // identifiers are looked up, so numbers like 1e5 or names like my_sampler2D are left alone.
+    auto result = std::string{};
+    result.reserve(contents.size() + contents.size() / 8 + 1);
+    auto const size = contents.size();
+    auto run_begin = size_t{0};
+    auto i = size_t{0};
+    while (i < size) {
+        auto const c = contents[i];
+        if (is_identifier_start(c)) {
+            auto const begin = i;
+            while (i < size && is_identifier_char(contents[i])) {
+                ++i;
+            }
+            auto const identifier = std::string_view{contents}.substr(begin, i - begin);
+            if (auto const *rewrite = find_identifier_rewrite(identifier, is_standard_code)) {
+                result.append(contents, run_begin, begin - run_begin);
+                result += rewrite->to;
+                run_begin = i;
+            }
+        } else if (c >= '0' && c <= '9') {
+            // Skip whole number literals, including suffixes and exponents.
+            while (i < size && (is_identifier_char(contents[i]) || contents[i] == '.')) {
+                ++i;
+            }
+        } else {
+            ++i;
+        }
+    }
+    result.append(contents, run_begin, size - run_begin);
+    if (result.empty() || result.back() != '\n') {
+        result += '\n';
+    }
+    contents.swap(result);
 }
 
+struct ShaderPassCompileJob {
+    std::string name;
+    std::string type;
+    std::vector<ShaderPassInput> inputs;
+    daxa::VirtualFileInfo code_file;
+    daxa::VirtualFileInfo inputs_file;
+    std::vector<daxa::ShaderDefine> defines;
+    daxa::Format format{};
+    uint32_t cube_size{};
+    // See ShaderBufferPass::reads_frame_inputs.
+    bool reads_frame_inputs = true;
+    // Everything that ends up in this pass' SPIR-V. Passes whose key matches the live one aren't recompiled.
+    SpirvCacheKey cache_key;
+
+    std::shared_ptr<daxa::RasterPipeline> pipeline;
+    // Only for the image pass, see ShaderBufferPass::swapchain_pipeline.
+    std::shared_ptr<daxa::RasterPipeline> swapchain_pipeline;
+    std::string error;
+    ShaderPassLoadTimings timings;
+};
+
+// A project load in flight. The compile jobs on the thread pool keep it alive, so a
+// superseded load can finish (or bail out early) after the viewport has moved on.
+struct ShaderLoad {
+    std::string shader_id;
+    Viewport::Clock::time_point start_time;
+    SpirvOptimization optimization{};
+    daxa::Format swapchain_format{};
+    std::vector<ShaderPassCompileJob> compile_jobs;
+    daxa::VirtualFileInfo common_file;
+    daxa::VirtualFileInfo user_code;
+    SpirvCacheKey shared_cache_key;
+    SpirvCacheKey vertex_cache_key;
+    GlslIncludeCache include_cache;
+    std::once_flag vertex_once;
+    GlslCompileResult vertex_result;
+    std::atomic_size_t jobs_remaining{};
+    std::atomic_bool cancelled{};
+    // Textures first used by this load. Their decode jobs write straight into the staging arena,
+    // and update_load() submits the copies at a frame boundary. The images are paired with their
+    // layer count.
+    daxa::BufferId texture_staging_buffer;
+    std::vector<TextureUpload> texture_uploads;
+    std::vector<std::pair<daxa::TaskImage, uint32_t>> texture_upload_images;
+    // Decode jobs also count towards jobs_remaining, this is for loads that superseded this one.
+    std::atomic_size_t texture_decodes_remaining{};
+    // A superseded load whose textures this one may use. They are uploaded along with its own.
+    std::shared_ptr<ShaderLoad> previous_load;
+    double texture_decode_ms{};
+    double texture_upload_ms{};
+};
+
 Viewport::Viewport(daxa::Device a_daxa_device)
     : daxa_device{std::move(a_daxa_device)},
-      pipeline_manager{[this]() {
-          auto result = daxa::PipelineManager(
-              daxa::PipelineManagerInfo2{
-                  .device = daxa_device,
-                  .root_paths = {DAXA_SHADER_INCLUDE_DIR, "src"},
-                  // .write_out_spirv = ".out/spv",
-                  .register_null_pipelines_when_first_compile_fails = true,
-                  .custom_preprocessor = shader_preprocess,
-                  .default_language = daxa::ShaderLanguage::GLSL,
-                  .default_enable_debug_info = false,
-                  .name = "pipeline_manager",
-              });
-          return result;
-      }()} {
+      spirv_cache{cache_dir / "spirv"},
+      pipeline_cache_stats{cache_dir / "pipelines", daxa_device.properties()} {
+    thread_pool.start();
     samplers[static_cast<size_t>(ShaderToyFilter::NEAREST) + static_cast<size_t>(ShaderToyWrap::CLAMP) * 3] = daxa_device.create_sampler({
         .magnification_filter = daxa::Filter::NEAREST,
         .minification_filter = daxa::Filter::NEAREST,
@@ -246,9 +703,50 @@ Viewport::Viewport(daxa::Device a_daxa_device)
         .min_lod = 0,
         .max_lod = MAX_MIP - 1,
     });
+
+    create_frame_resources();
+    create_mipmap_pipeline();
+    keyboard_image = daxa_device.create_image({
+        .format = daxa::Format::R8_UINT,
+        .size = {256, 3, 1},
+        .usage = daxa::ImageUsageFlagBits::SHADER_SAMPLED | daxa::ImageUsageFlagBits::TRANSFER_DST,
+        .name = "keyboard_image",
+    });
+    task_keyboard_image = daxa::TaskImage({.initial_images = {std::array{keyboard_image}}, .name = "keyboard_image"});
+
+    keyboard_upload_task_graph = daxa::TaskGraph({
+        .device = daxa_device,
+        .name = "keyboard_upload_task_graph",
+    });
+    keyboard_upload_task_graph.use_persistent_image(task_keyboard_image);
+    keyboard_upload_task_graph.add_task({
+        .attachments = {
+            daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_keyboard_image),
+        },
+        .task = [this](daxa::TaskInterface const &ti) {
+            ti.recorder.copy_buffer_to_image({
+                .buffer = upload_ring,
+                .buffer_offset = upload_slot_offset() + offsetof(UploadRingSlot, keyboard_input),
+                .image = ti.get(task_keyboard_image).ids[0],
+                .image_extent = {256, 3, 1},
+            });
+        },
+        .name = "KeyboardInputUploadTask",
+    });
+    keyboard_upload_task_graph.submit({});
+    keyboard_upload_task_graph.complete({});
 }
 
 Viewport::~Viewport() {
+    if (pending_load) {
+        pending_load->cancelled = true;
+    }
+    thread_pool.stop();
+    for (auto *load = pending_load.get(); load != nullptr; load = load->previous_load.get()) {
+        if (!load->texture_staging_buffer.is_empty()) {
+            daxa_device.destroy_buffer(load->texture_staging_buffer);
+        }
+    }
     for (auto &sampler : samplers) {
         daxa_device.destroy_sampler(sampler);
     }
@@ -256,6 +754,8 @@ Viewport::~Viewport() {
         auto &[image_id, idx] = elem;
         daxa_device.destroy_image(image_id);
     }
+    daxa_device.destroy_buffer(upload_ring);
+    daxa_device.destroy_image(keyboard_image);
 }
 
 void Viewport::update() {
@@ -274,74 +774,231 @@ void Viewport::update() {
 }
 
 void Viewport::render() {
-    for (auto &pass : buffer_passes) {
-        pass.buffer.swap();
+    // The swapchain acquire already waited for the frame that last used this slot.
+    upload_ring_slot = (upload_ring_slot + 1) % frames_in_flight;
+    gpu_profiler.begin_frame(upload_ring_slot);
+    auto *slot = reinterpret_cast<UploadRingSlot *>(upload_ring_ptr + upload_slot_offset());
+    slot->gpu_input = gpu_input;
+    keyboard_upload_pending = keyboard_dirty;
+    if (keyboard_dirty) {
+        slot->keyboard_input = keyboard_input;
+        keyboard_dirty = false;
+        // Submitted ahead of the frame's graph, which then only reads the keyboard image.
+        keyboard_upload_task_graph.execute({});
+    }
+
+    // Frame invariant passes only render when something they read changed. They render twice in a
+    // row then, so that both ping-pong images hold the result before they start skipping.
+    auto const input_changed = [this](ShaderPassInput const &input) {
+        switch (input.type) {
+        case ShaderPassInputType::BUFFER: return buffer_passes[input.index].renders_this_frame;
+        case ShaderPassInputType::CUBE: return cube_passes[input.index].renders_this_frame;
+        case ShaderPassInputType::KEYBOARD: return keyboard_upload_pending;
+        default: return false;
+        }
+    };
+    auto const update_pass = [&](auto &pass) {
+        if (!pass.reachable) {
+            return;
+        }
+        if (!pass.frame_invariant) {
+            pass.renders_this_frame = true;
+        } else {
+            if (std::ranges::any_of(pass.inputs, input_changed)) {
+                pass.pending_renders = 2;
+            }
+            pass.renders_this_frame = pass.pending_renders > 0;
+            if (pass.renders_this_frame) {
+                --pass.pending_renders;
+            }
+        }
+        // A skipped pass keeps its last output where the passes after it read it from.
+        if (pass.renders_this_frame) {
+            pass.buffer.swap();
+        }
         pass.recording_buffer_view = pass.buffer.task_resources.history_resource;
+    };
+    for (auto &pass : buffer_passes) {
+        update_pass(pass);
     }
     for (auto &pass : cube_passes) {
-        pass.buffer.swap();
-        pass.recording_buffer_view = pass.buffer.task_resources.history_resource;
+        update_pass(pass);
     }
 }
 
-auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
-    auto viewport_render_image = task_graph.create_transient_image({
-        .format = daxa::Format::R16G16B16A16_SFLOAT,
-        .size = {static_cast<uint32_t>(gpu_input.Resolution.x), static_cast<uint32_t>(gpu_input.Resolution.y), 1},
-        .name = "viewport_render_image",
+void Viewport::set_frames_in_flight(uint32_t count) {
+    if (count == frames_in_flight) {
+        return;
+    }
+    frames_in_flight = count;
+    daxa_device.destroy_buffer(upload_ring);
+    create_frame_resources();
+}
+
+void Viewport::create_frame_resources() {
+    upload_ring = daxa_device.create_buffer({
+        .size = static_cast<uint32_t>(UPLOAD_RING_SLOT_STRIDE * frames_in_flight),
+        .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_SEQUENTIAL_WRITE,
+        .name = "upload_ring",
+    });
+    upload_ring_ptr = daxa_device.buffer_host_address(upload_ring).value();
+    upload_ring_slot = 0;
+    timestamp_pool = daxa_device.create_timeline_query_pool({
+        .query_count = 2 * frames_in_flight,
+        .name = "viewport_timestamps",
     });
+    timestamps_written.assign(frames_in_flight, false);
+    gpu_profiler.create(daxa_device, frames_in_flight);
+    // The new slots don't hold any keyboard state yet.
+    keyboard_dirty = true;
+}
+
+auto Viewport::upload_slot_offset() const -> size_t {
+    return UPLOAD_RING_SLOT_STRIDE * upload_ring_slot;
+}
+
+void Viewport::create_mipmap_pipeline() {
+    const auto shader_include_dir = resource_dir / std::filesystem::path("src");
+    auto source = read_text_file(shader_include_dir / "app/mipmap.glsl");
+    if (!source) {
+        core::log_error("Failed to open app/mipmap.glsl, falling back to blitting mip maps");
+        return;
+    }
+    auto cache_key = SpirvCacheKey{};
+    cache_key.append("mipmap-spirv-2");
+    cache_key.append(glslang_version_string());
+    for (auto const &include_file : collect_include_files(shader_include_dir / "app/mipmap.glsl", shader_root_paths(shader_include_dir))) {
+        cache_key.append(include_file.second);
+    }
+    auto spirv = spirv_cache.load(cache_key);
+    if (!spirv) {
+        auto result = compile_glsl({
+            .source_path = shader_include_dir / "app/mipmap.glsl",
+            .source = std::move(*source),
+            .stage = ShaderStage::COMPUTE,
+            .root_paths = shader_root_paths(shader_include_dir),
+            .name = "mipmap",
+        });
+        if (!result.error.empty()) {
+            core::log_error("Failed to compile the mip map shader, falling back to blitting mip maps:\n" + result.error);
+            return;
+        }
+        spirv_cache.store(cache_key, result.spirv);
+        spirv = std::move(result.spirv);
+    }
+    mipmap_pipeline = std::make_shared<daxa::ComputePipeline>(daxa_device.create_compute_pipeline({
+        .shader_info = daxa::ShaderInfo{
+            .byte_code = spirv->data(),
+            .byte_code_size = static_cast<uint32_t>(spirv->size()),
+        },
+        .push_constant_size = sizeof(MipmapPush),
+        .name = "mipmap",
+    }));
+}
+
+void Viewport::record_mipmaps(daxa::TaskGraph &task_graph, daxa::TaskImageView const &image, uint32_t layer_count, uint32_t mip_level_count, std::string const &name, bool const *renders_this_frame) {
+    if (!mipmap_pipeline) {
+        for (uint32_t mip = 0; mip + 1 < mip_level_count; ++mip) {
+            task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_READ, daxa::ImageViewType::REGULAR_2D_ARRAY, image.view({.base_mip_level = mip, .layer_count = layer_count})),
+                    daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D_ARRAY, image.view({.base_mip_level = mip + 1, .layer_count = layer_count})),
+                },
+                .task = gpu_profiler.wrap(std::string("mip map ") + std::to_string(mip) + " " + name, [mip, layer_count, renders_this_frame](daxa::TaskInterface ti) {
+                    if (!*renders_this_frame) {
+                        return;
+                    }
+                    do_blit(ti, ti.get(daxa::TaskImageAttachmentIndex{0}).ids[0], ti.get(daxa::TaskImageAttachmentIndex{1}).ids[0], mip, layer_count);
+                }),
+                .name = std::string("mip map ") + std::to_string(mip) + " " + name,
+            });
+        }
+        return;
+    }
+
+    // Each dispatch reads one level and writes the next MIPMAP_LEVELS_PER_DISPATCH, so 9 levels
+    // take two, with the graph's barrier in between.
+    for (uint32_t base_mip = 0; base_mip + 1 < mip_level_count; base_mip += MIPMAP_LEVELS_PER_DISPATCH) {
+        auto const level_count = std::min<uint32_t>(MIPMAP_LEVELS_PER_DISPATCH, mip_level_count - 1 - base_mip);
+        auto attachments = std::vector<daxa::TaskAttachmentInfo>{
+            daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_SAMPLED, daxa::ImageViewType::REGULAR_2D_ARRAY, image.view({.base_mip_level = base_mip, .layer_count = layer_count})),
+        };
+        for (uint32_t i = 0; i < level_count; ++i) {
+            attachments.push_back(daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_WRITE_ONLY, daxa::ImageViewType::REGULAR_2D_ARRAY, image.view({.base_mip_level = base_mip + 1 + i, .layer_count = layer_count})));
+        }
+        task_graph.add_task({
+            .attachments = attachments,
+            .task = gpu_profiler.wrap(std::string("mip maps ") + std::to_string(base_mip + 1) + "+ " + name, [this, base_mip, level_count, layer_count, renders_this_frame](daxa::TaskInterface const &ti) {
+                if (!*renders_this_frame) {
+                    return;
+                }
+                auto const image_size = ti.device.image_info(ti.get(daxa::TaskImageAttachmentIndex{0}).ids[0]).value().size;
+                auto push = MipmapPush{
+                    .src = ti.get(daxa::TaskImageAttachmentIndex{0}).view_ids[0],
+                    .src_size = {std::max(1u, image_size.x >> base_mip), std::max(1u, image_size.y >> base_mip)},
+                    .level_count = level_count,
+                };
+                for (uint32_t i = 0; i < level_count; ++i) {
+                    push.dst[i] = ti.get(daxa::TaskImageAttachmentIndex{1 + i}).view_ids[0];
+                }
+                ti.recorder.set_pipeline(*mipmap_pipeline);
+                ti.recorder.push_constant(push);
+                ti.recorder.dispatch({
+                    .x = (push.src_size.x + MIPMAP_TILE_SIZE - 1) / MIPMAP_TILE_SIZE,
+                    .y = (push.src_size.y + MIPMAP_TILE_SIZE - 1) / MIPMAP_TILE_SIZE,
+                    .z = layer_count,
+                });
+            }),
+            .name = std::string("mip maps ") + std::to_string(base_mip + 1) + "+ " + name,
+        });
+    }
+}
+
+auto Viewport::record(daxa::TaskGraph &task_graph, std::optional<ViewportTarget> const &direct_target) -> std::optional<daxa::TaskImageView> {
+    auto const render_direct = direct_target.has_value() && can_render_direct(direct_target->format);
+    auto viewport_render_image = daxa::TaskImageView{};
+    if (render_direct) {
+        viewport_render_image = direct_target->image;
+    } else {
+        viewport_render_image = task_graph.create_transient_image({
+            .format = daxa::Format::R16G16B16A16_SFLOAT,
+            .size = {static_cast<uint32_t>(gpu_input.Resolution.x), static_cast<uint32_t>(gpu_input.Resolution.y), 1},
+            .name = "viewport_render_image",
+        });
+    }
 
     for (auto const &task_texture : task_textures) {
         task_graph.use_persistent_image(task_texture);
     }
 
-    auto task_input_buffer = task_graph.create_transient_buffer({
-        .size = static_cast<uint32_t>(sizeof(GpuInput)),
-        .name = "input_buffer",
-    });
-    auto task_keyboard_image = task_graph.create_transient_image({
-        .format = daxa::Format::R8_UINT,
-        .size = {256, 3, 1},
-        .name = "keyboard_image",
-    });
+    // Once copied, the pre-resize images are only referenced by the graphs being replaced now.
+    if (!resize_copy_pending) {
+        for (auto &pass : buffer_passes) {
+            pass.resize_source = {};
+        }
+    }
 
-    // GpuInputUploadTransferTask
-    task_graph.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_input_buffer),
-        },
-        .task = [this, task_input_buffer](daxa::TaskInterface const &ti) {
-            auto &cmd_list = ti.recorder;
-            GpuInputUploadTransferTask_record(daxa_device, cmd_list, ti.get(daxa::TaskBufferAttachmentIndex{0}).ids[0], gpu_input);
-        },
-        .name = "GpuInputUploadTransferTask",
-    });
+    // The images may be new or resized, so frame invariant passes have to render again.
+    for (auto &pass : buffer_passes) {
+        pass.pending_renders = 2;
+    }
+    for (auto &pass : cube_passes) {
+        pass.pending_renders = 2;
+    }
+
+    task_graph.use_persistent_image(task_keyboard_image);
 
-    // KeyboardInputUploadTask
+    // Starts the viewport's GPU timer. It doesn't touch any resource, so it runs ahead of the passes.
     task_graph.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_keyboard_image),
+        .attachments = {},
+        .task = [this](daxa::TaskInterface const &ti) {
+            ti.recorder.reset_timestamps({.query_pool = timestamp_pool, .start_index = 2 * upload_ring_slot, .count = 2});
+            ti.recorder.write_timestamp({.query_pool = timestamp_pool, .pipeline_stage = daxa::PipelineStageFlagBits::TOP_OF_PIPE, .query_index = 2 * upload_ring_slot});
         },
-        .task = [this, task_keyboard_image](daxa::TaskInterface const &ti) {
-            auto &cmd_list = ti.recorder;
-            auto staging_buffer = daxa_device.create_buffer({
-                .size = sizeof(KeyboardInput),
-                .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                .name = "staging_buffer",
-            });
-            cmd_list.destroy_buffer_deferred(staging_buffer);
-            auto *buffer_ptr = daxa_device.buffer_host_address_as<KeyboardInput>(staging_buffer).value();
-            *buffer_ptr = keyboard_input;
-            cmd_list.copy_buffer_to_image({
-                .buffer = staging_buffer,
-                .image = ti.get(task_keyboard_image).ids[0],
-                .image_extent = {256, 3, 1},
-            });
-        },
-        .name = "KeyboardInputUploadTask",
+        .name = "viewport timer start",
     });
 
-    auto get_resource_view = [this, task_keyboard_image](ShaderPassInput const &input) -> daxa::TaskImageView {
+    auto get_resource_view = [this](ShaderPassInput const &input) -> daxa::TaskImageView {
         switch (input.type) {
         case ShaderPassInputType::BUFFER: return buffer_passes[input.index].recording_buffer_view;
         case ShaderPassInputType::CUBE: return cube_passes[input.index].recording_buffer_view;
@@ -354,11 +1011,11 @@ auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
         return {};
     };
 
-    auto get_resource_view_slice = [get_resource_view](ShaderPassInput const &input) -> daxa::TaskImageView {
+    auto get_resource_view_slice = [this, get_resource_view](ShaderPassInput const &input) -> daxa::TaskImageView {
         auto view = get_resource_view(input);
         switch (input.type) {
-        case ShaderPassInputType::BUFFER: return view.view({.level_count = MAX_MIP});
-        case ShaderPassInputType::CUBE: return view.view({.layer_count = 6});
+        case ShaderPassInputType::BUFFER: return view.view({.level_count = buffer_passes[input.index].mip_level_count});
+        case ShaderPassInputType::CUBE: return view.view({.level_count = cube_passes[input.index].mip_level_count, .layer_count = 6});
         case ShaderPassInputType::KEYBOARD:
         case ShaderPassInputType::TEXTURE:
         case ShaderPassInputType::VOLUME_TEXTURE: return view;
@@ -368,77 +1025,134 @@ auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
     };
 
     for (auto &pass : buffer_passes) {
+        if (!pass.reachable) {
+            pass.buffer = PingPongImage{};
+            continue;
+        }
+        auto usage = daxa::ImageUsageFlagBits::COLOR_ATTACHMENT | daxa::ImageUsageFlagBits::SHADER_SAMPLED | daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::TRANSFER_DST;
+        if (pass.needs_mipmap && mipmap_pipeline) {
+            usage |= daxa::ImageUsageFlagBits::SHADER_STORAGE;
+        }
+        auto const width = static_cast<uint32_t>(gpu_input.Resolution.x);
+        auto const height = static_cast<uint32_t>(gpu_input.Resolution.y);
         auto const image_info = daxa::ImageInfo{
             .format = daxa::Format::R32G32B32A32_SFLOAT,
-            .size = {static_cast<uint32_t>(gpu_input.Resolution.x), static_cast<uint32_t>(gpu_input.Resolution.y), 1},
-            .mip_level_count = MAX_MIP,
-            .usage = daxa::ImageUsageFlagBits::COLOR_ATTACHMENT | daxa::ImageUsageFlagBits::SHADER_SAMPLED | daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::TRANSFER_DST,
+            .size = {width, height, 1},
+            // Only allocate the mip chain when some pass samples this one with a mipmap filter.
+            .mip_level_count = mip_level_count(pass.needs_mipmap, width, height),
+            .usage = usage,
             .name = std::string{"buffer "} + std::string{pass.name},
         };
-        if (first_record_after_load) {
-            pass.buffer = {};
+        auto const needs_realloc = [&]() {
+            auto const old_info = daxa_device.image_info(pass.buffer.resources.resource_a).value();
+            return old_info.size.x != image_info.size.x || old_info.size.y != image_info.size.y || old_info.mip_level_count != image_info.mip_level_count;
+        };
+        if (pass.buffer.resources.resource_a.is_empty()) {
             pass.buffer.get(daxa_device, image_info);
-        } else {
-            // resize the image while keeping the contents
-            auto temp_task_graph = daxa::TaskGraph(daxa::TaskGraphInfo{
-                .device = daxa_device,
-                .name = "temp_tg",
-            });
-            auto new_buffer = PingPongImage{};
-            new_buffer.get(daxa_device, image_info);
-            temp_task_graph.use_persistent_image(pass.buffer.task_resources.history_resource);
-            temp_task_graph.use_persistent_image(new_buffer.task_resources.output_resource);
-            auto output_image_view_a = pass.buffer.task_resources.history_resource.view().view({.level_count = MAX_MIP});
-            auto output_image_view_b = new_buffer.task_resources.output_resource.view().view({.level_count = MAX_MIP});
-            temp_task_graph.add_task({
-                .attachments = {
-                    daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_READ, daxa::ImageViewType::REGULAR_2D, output_image_view_a),
-                    daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, output_image_view_b),
-                },
-                .task = [output_image_view_a, output_image_view_b](daxa::TaskInterface const &ti) {
-                    auto &recorder = ti.recorder;
-                    auto size_a = ti.device.image_info(ti.get(output_image_view_a).ids[0]).value().size;
-                    auto size_b = ti.device.image_info(ti.get(output_image_view_b).ids[0]).value().size;
-                    auto size = daxa_i32vec2{
-                        std::min(static_cast<int32_t>(size_a.x), static_cast<int32_t>(size_b.x)),
-                        std::min(static_cast<int32_t>(size_a.y), static_cast<int32_t>(size_b.y)),
-                    };
-                    recorder.blit_image_to_image({
-                        .src_image = ti.get(output_image_view_a).ids[0],
-                        .src_image_layout = ti.get(output_image_view_a).layout,
-                        .dst_image = ti.get(output_image_view_b).ids[0],
-                        .dst_image_layout = ti.get(output_image_view_b).layout,
-                        .src_offsets = {{{0, 0, 0}, {size.x, size.y, 1}}},
-                        .dst_offsets = {{{0, 0, 0}, {size.x, size.y, 1}}},
-                        .filter = daxa::Filter::NEAREST,
-                    });
-                },
-                .name = "resize_blit",
-            });
-            temp_task_graph.submit({});
-            temp_task_graph.complete({});
-            temp_task_graph.execute({});
-            pass.buffer = std::move(new_buffer);
+        } else if (needs_realloc()) {
+            // If the last resize wasn't copied yet, the current images were never rendered to, and
+            // the copy still has to come from the ones before.
+            if (!resize_copy_pending || pass.resize_source.resources.resource_a.is_empty()) {
+                pass.resize_source = std::move(pass.buffer);
+            }
+            pass.buffer = PingPongImage{};
+            pass.buffer.get(daxa_device, image_info);
+            resize_copy_pending = true;
         }
+        pass.mip_level_count = image_info.mip_level_count;
         pass.recording_buffer_view = pass.buffer.task_resources.history_resource;
         task_graph.use_persistent_image(pass.buffer.task_resources.output_resource);
         task_graph.use_persistent_image(pass.buffer.task_resources.history_resource);
     }
 
+    buffer_memory = {};
+    for (auto const &pass : buffer_passes) {
+        if (!pass.reachable) {
+            continue;
+        }
+        auto info = daxa_device.image_info(pass.buffer.resources.resource_a).value();
+        auto const allocated = daxa_device.image_memory_requirements(info).size;
+        info.mip_level_count = mip_level_count(true, info.size.x, info.size.y);
+        auto const with_mips = daxa_device.image_memory_requirements(info).size;
+        // Ping and pong.
+        buffer_memory.allocated_bytes += 2 * allocated;
+        buffer_memory.saved_bytes += 2 * (with_mips - allocated);
+    }
+
+    if (resize_copy_pending) {
+        // Keep the contents of resized buffers: one task copies all of them into the images the passes
+        // read as history on the next frame. Every graph gets it, whichever runs first does the copy.
+        auto attachments = std::vector<daxa::TaskAttachmentInfo>{};
+        auto copies = std::vector<std::pair<daxa::TaskImageView, daxa::TaskImageView>>{};
+        for (auto &pass : buffer_passes) {
+            if (!pass.reachable || pass.resize_source.resources.resource_a.is_empty()) {
+                continue;
+            }
+            task_graph.use_persistent_image(pass.resize_source.task_resources.output_resource);
+            auto src = pass.resize_source.task_resources.output_resource.view();
+            auto dst = pass.buffer.task_resources.history_resource.view();
+            attachments.push_back(daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_READ, daxa::ImageViewType::REGULAR_2D, src));
+            attachments.push_back(daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, dst));
+            copies.emplace_back(src, dst);
+        }
+        task_graph.add_task({
+            .attachments = attachments,
+            .task = gpu_profiler.wrap("resize copy", [this, copies](daxa::TaskInterface const &ti) {
+                if (!resize_copy_pending) {
+                    return;
+                }
+                resize_copy_pending = false;
+                resize_copy_done = true;
+                for (auto const &[src, dst] : copies) {
+                    auto size_a = ti.device.image_info(ti.get(src).ids[0]).value().size;
+                    auto size_b = ti.device.image_info(ti.get(dst).ids[0]).value().size;
+                    auto src_size = daxa_i32vec2{static_cast<int32_t>(size_a.x), static_cast<int32_t>(size_a.y)};
+                    auto dst_size = daxa_i32vec2{static_cast<int32_t>(size_b.x), static_cast<int32_t>(size_b.y)};
+                    if (!resize_copy_stretch) {
+                        src_size = dst_size = daxa_i32vec2{std::min(src_size.x, dst_size.x), std::min(src_size.y, dst_size.y)};
+                    }
+                    ti.recorder.blit_image_to_image({
+                        .src_image = ti.get(src).ids[0],
+                        .src_image_layout = ti.get(src).layout,
+                        .dst_image = ti.get(dst).ids[0],
+                        .dst_image_layout = ti.get(dst).layout,
+                        .src_offsets = {{{0, 0, 0}, {src_size.x, src_size.y, 1}}},
+                        .dst_offsets = {{{0, 0, 0}, {dst_size.x, dst_size.y, 1}}},
+                        .filter = resize_copy_stretch ? daxa::Filter::LINEAR : daxa::Filter::NEAREST,
+                    });
+                }
+            }),
+            .name = "resize_copy",
+        });
+    }
+
     for (auto &pass : cube_passes) {
-        if (first_record_after_load) {
-            pass.buffer = {};
-        }
-        pass.buffer.get(
-            daxa_device,
-            daxa::ImageInfo{
-                .format = daxa::Format::R16G16B16A16_SFLOAT,
-                .size = {1024, 1024, 1},
-                .mip_level_count = 1,
-                .array_layer_count = 6,
-                .usage = daxa::ImageUsageFlagBits::COLOR_ATTACHMENT | daxa::ImageUsageFlagBits::SHADER_SAMPLED | daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::TRANSFER_DST,
-                .name = std::string{"cube buffer "} + std::string{pass.name},
-            });
+        if (!pass.reachable) {
+            pass.buffer = PingPongImage{};
+            continue;
+        }
+        auto usage = daxa::ImageUsageFlagBits::COLOR_ATTACHMENT | daxa::ImageUsageFlagBits::SHADER_SAMPLED | daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::TRANSFER_DST;
+        if (pass.needs_mipmap && mipmap_pipeline) {
+            usage |= daxa::ImageUsageFlagBits::SHADER_STORAGE;
+        }
+        auto const image_info = daxa::ImageInfo{
+            .format = pass.format,
+            .size = {pass.size, pass.size, 1},
+            .mip_level_count = mip_level_count(pass.needs_mipmap, pass.size, pass.size),
+            .array_layer_count = 6,
+            .usage = usage,
+            .name = std::string{"cube buffer "} + std::string{pass.name},
+        };
+        // Cube maps don't depend on the viewport size, so they're only reallocated when the project changes them.
+        auto const needs_realloc = [&]() {
+            auto const old_info = daxa_device.image_info(pass.buffer.resources.resource_a).value();
+            return old_info.size.x != image_info.size.x || old_info.format != image_info.format || old_info.mip_level_count != image_info.mip_level_count;
+        };
+        if (!pass.buffer.resources.resource_a.is_empty() && needs_realloc()) {
+            pass.buffer = PingPongImage{};
+        }
+        pass.buffer.get(daxa_device, image_info);
+        pass.mip_level_count = image_info.mip_level_count;
         pass.recording_buffer_view = pass.buffer.task_resources.history_resource;
 
         task_graph.use_persistent_image(pass.buffer.task_resources.output_resource);
@@ -446,8 +1160,10 @@ auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
     }
 
     for (auto &pass : buffer_passes) {
+        if (!pass.reachable) {
+            continue;
+        }
         auto uses = std::vector<daxa::TaskAttachmentInfo>{};
-        uses.push_back(daxa::inl_attachment(daxa::TaskBufferAccess::FRAGMENT_SHADER_READ, task_input_buffer));
         for (auto const &input : pass.inputs) {
             if (input.type == ShaderPassInputType::NONE) {
                 continue;
@@ -465,11 +1181,14 @@ auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
         uses.push_back(daxa::inl_attachment(daxa::TaskImageAccess::COLOR_ATTACHMENT, daxa::ImageViewType::REGULAR_2D, output_view));
         task_graph.add_task({
             .attachments = uses,
-            .task = [this, &pass, task_input_buffer, get_resource_view_slice, pipeline, inputs, output_view](daxa::TaskInterface const &ti) {
+            .task = gpu_profiler.wrap(std::string("buffer ") + pass.name, [this, &pass, get_resource_view_slice, pipeline, inputs, output_view](daxa::TaskInterface const &ti) {
+                if (!pass.renders_this_frame) {
+                    return;
+                }
                 auto &cmd_list = ti.recorder;
                 auto input_images = InputImages{};
                 auto size = ti.device.image_info(ti.get(output_view).ids[0]).value().size;
-                uint32_t i = 1;
+                uint32_t i = 0;
                 for (auto const &input : pass.inputs) {
                     if (input.type == ShaderPassInputType::NONE) {
                         continue;
@@ -481,35 +1200,25 @@ auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
                 ShaderToyTask_record(
                     pipeline,
                     cmd_list,
-                    daxa_device.buffer_device_address(ti.get(task_input_buffer).ids[0]).value(),
+                    daxa_device.buffer_device_address(upload_ring).value() + upload_slot_offset(),
                     input_images,
                     ti.get(output_view).ids[0],
                     daxa_u32vec2{size.x, size.y});
                 pass.recording_buffer_view = pass.buffer.task_resources.output_resource;
-            },
+            }),
             .name = std::string("buffer task ") + pass.name,
         });
         pass.recording_buffer_view = pass.buffer.task_resources.output_resource;
         if (pass.needs_mipmap) {
-            for (uint32_t mip = 0; mip < MAX_MIP - 1; ++mip) {
-                task_graph.add_task({
-                    .attachments = {
-                        daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_READ, daxa::ImageViewType::REGULAR_2D, output_view.view({.base_mip_level = mip})),
-                        daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, output_view.view({.base_mip_level = mip + 1})),
-                    },
-                    .task = [mip](daxa::TaskInterface ti) {
-                        auto &recorder = ti.recorder;
-                        do_blit(ti, ti.get(daxa::TaskImageAttachmentIndex{0}).ids[0], ti.get(daxa::TaskImageAttachmentIndex{1}).ids[0], mip);
-                    },
-                    .name = std::string("mip map ") + std::to_string(mip),
-                });
-            }
+            record_mipmaps(task_graph, output_view, 1, pass.mip_level_count, pass.name, &pass.renders_this_frame);
         }
     }
 
     for (auto &pass : cube_passes) {
+        if (!pass.reachable) {
+            continue;
+        }
         auto uses = std::vector<daxa::TaskAttachmentInfo>{};
-        uses.push_back(daxa::inl_attachment(daxa::TaskBufferAccess::FRAGMENT_SHADER_READ, task_input_buffer));
         for (auto const &input : pass.inputs) {
             if (input.type == ShaderPassInputType::NONE) {
                 continue;
@@ -529,9 +1238,16 @@ auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
         auto pipeline = pass.pipeline;
         auto inputs = pass.inputs;
         auto output_view = pass.buffer.task_resources.output_resource.view();
+        auto face_scopes = std::array<uint32_t, 6>{};
+        for (uint32_t i = 0; i < 6; ++i) {
+            face_scopes[i] = gpu_profiler.scope(std::string("cube ") + pass.name + " face " + std::to_string(i));
+        }
         task_graph.add_task({
             .attachments = uses,
-            .task = [this, &pass, task_input_buffer, get_resource_view_slice, pipeline, inputs, output_view, face_views](daxa::TaskInterface const &ti) {
+            .task = [this, &pass, get_resource_view_slice, pipeline, inputs, output_view, face_views, face_scopes](daxa::TaskInterface const &ti) {
+                if (!pass.renders_this_frame) {
+                    return;
+                }
                 auto &cmd_list = ti.recorder;
                 auto input_images = InputImages{};
                 auto size = ti.device.image_info(ti.get(output_view).ids[0]).value().size;
@@ -542,26 +1258,33 @@ auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
                     input_images.Channel[input.channel] = ti.get(get_resource_view_slice(input)).view_ids[0];
                     input_images.Channel_sampler[input.channel] = input.sampler;
                 }
+                // daxa's render passes are single layer without a view mask, so the faces can't be
+                // rendered layered or with multiview, and each gets its own render pass.
                 for (uint32_t i = 0; i < 6; ++i) {
+                    gpu_profiler.begin(cmd_list, face_scopes[i]);
                     ShaderToyCubeTask_record(
                         pipeline,
                         cmd_list,
-                        daxa_device.buffer_device_address(ti.get(task_input_buffer).ids[0]).value(),
+                        daxa_device.buffer_device_address(upload_ring).value() + upload_slot_offset(),
                         input_images,
                         ti.get(face_views[i]).view_ids[0],
+                        size.x,
                         i);
+                    gpu_profiler.end(cmd_list, face_scopes[i]);
                 }
                 pass.recording_buffer_view = pass.buffer.task_resources.output_resource;
             },
             .name = std::string("cube task ") + pass.name,
         });
         pass.recording_buffer_view = pass.buffer.task_resources.output_resource;
+        if (pass.needs_mipmap) {
+            record_mipmaps(task_graph, output_view, 6, pass.mip_level_count, pass.name, &pass.renders_this_frame);
+        }
     }
 
     {
         auto &pass = image_pass;
         auto uses = std::vector<daxa::TaskAttachmentInfo>{};
-        uses.push_back(daxa::inl_attachment(daxa::TaskBufferAccess::FRAGMENT_SHADER_READ, task_input_buffer));
         for (auto const &input : pass.inputs) {
             if (input.type == ShaderPassInputType::NONE) {
                 continue;
@@ -573,13 +1296,14 @@ auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
                 uses.push_back(daxa::inl_attachment(daxa::TaskImageAccess::FRAGMENT_SHADER_SAMPLED, daxa::ImageViewType::REGULAR_2D, get_resource_view_slice(input)));
             }
         }
-        auto pipeline = pass.pipeline;
+        auto pipeline = render_direct ? pass.swapchain_pipeline : pass.pipeline;
         auto inputs = pass.inputs;
         auto output_view = viewport_render_image;
+        auto get_offset = render_direct ? direct_target->get_offset : std::function<daxa_i32vec2()>{};
         uses.push_back(daxa::inl_attachment(daxa::TaskImageAccess::COLOR_ATTACHMENT, daxa::ImageViewType::REGULAR_2D, output_view));
         task_graph.add_task({
             .attachments = uses,
-            .task = [this, &pass, task_input_buffer, get_resource_view_slice, pipeline, inputs, output_view](daxa::TaskInterface const &ti) {
+            .task = gpu_profiler.wrap("image", [this, &pass, get_resource_view_slice, pipeline, inputs, output_view, get_offset](daxa::TaskInterface const &ti) {
                 auto &cmd_list = ti.recorder;
                 auto input_images = InputImages{};
                 auto size = ti.device.image_info(ti.get(output_view).ids[0]).value().size;
@@ -590,35 +1314,109 @@ auto Viewport::record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView {
                     input_images.Channel[input.channel] = ti.get(get_resource_view_slice(input)).view_ids[0];
                     input_images.Channel_sampler[input.channel] = input.sampler;
                 }
+                auto offset = daxa_i32vec2{0, 0};
+                auto render_size = daxa_u32vec2{size.x, size.y};
+                if (get_offset) {
+                    // Render into the viewport's rect of the target. The y flip the blit would otherwise do
+                    // happens on fragCoord instead.
+                    offset = get_offset();
+                    offset.x = std::clamp(offset.x, 0, static_cast<int32_t>(size.x));
+                    offset.y = std::clamp(offset.y, 0, static_cast<int32_t>(size.y));
+                    render_size = daxa_u32vec2{
+                        std::min(static_cast<uint32_t>(gpu_input.Resolution.x), size.x - static_cast<uint32_t>(offset.x)),
+                        std::min(static_cast<uint32_t>(gpu_input.Resolution.y), size.y - static_cast<uint32_t>(offset.y)),
+                    };
+                }
                 ShaderToyTask_record(
                     pipeline,
                     cmd_list,
-                    daxa_device.buffer_device_address(ti.get(task_input_buffer).ids[0]).value(),
+                    daxa_device.buffer_device_address(upload_ring).value() + upload_slot_offset(),
                     input_images,
                     ti.get(output_view).ids[0],
-                    daxa_u32vec2{size.x, size.y});
-            },
+                    render_size,
+                    offset,
+                    static_cast<bool>(get_offset));
+                ti.recorder.write_timestamp({.query_pool = timestamp_pool, .pipeline_stage = daxa::PipelineStageFlagBits::BOTTOM_OF_PIPE, .query_index = 2 * upload_ring_slot + 1});
+                timestamps_written[upload_ring_slot] = true;
+            }),
             .name = "image task",
         });
-        if (pass.needs_mipmap) {
-            for (uint32_t mip = 0; mip < MAX_MIP - 1; ++mip) {
-                task_graph.add_task({
-                    .attachments = {
-                        daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_READ, daxa::ImageViewType::REGULAR_2D, output_view.view({.base_mip_level = mip})),
-                        daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, output_view.view({.base_mip_level = mip + 1})),
-                    },
-                    .task = [mip](daxa::TaskInterface ti) {
-                        do_blit(ti, ti.get(daxa::TaskImageAttachmentIndex{0}).ids[0], ti.get(daxa::TaskImageAttachmentIndex{1}).ids[0], mip);
-                    },
-                    .name = std::string("mip map ") + std::to_string(mip),
-                });
+    }
+
+    if (render_direct) {
+        return std::nullopt;
+    }
+    return viewport_render_image;
+}
+
+void Viewport::set_viewport_size(daxa_f32vec2 size) {
+    if (size.x != display_size.x || size.y != display_size.y) {
+        display_size = size;
+        // The window was resized, so buffer contents keep their pixel positions.
+        resize_copy_stretch = false;
+    }
+    auto const scale = dynamic_resolution.scale();
+    auto const render_size = daxa_f32vec2{
+        std::max(1.0f, std::round(size.x * scale)),
+        std::max(1.0f, std::round(size.y * scale)),
+    };
+    gpu_input.Resolution = daxa_f32vec3{render_size.x, render_size.y, 1.0f};
+    gpu_input.ChannelResolution[0] = daxa_f32vec3{render_size.x, render_size.y, 1.0f};
+}
+
+auto Viewport::take_resize_copy_done() -> bool {
+    return std::exchange(resize_copy_done, false);
+}
+
+auto Viewport::update_render_scale() -> bool {
+    auto changed = false;
+    if (!dynamic_resolution.enabled) {
+        changed = dynamic_resolution.reset();
+    } else {
+        // render() writes to the next slot, whose previous frame the swapchain acquire waited for.
+        auto const slot = (upload_ring_slot + 1) % frames_in_flight;
+        if (timestamps_written[slot]) {
+            auto const results = timestamp_pool.get_query_results(2 * slot, 2);
+            // Value and availability, per query.
+            if (results.size() == 4 && results[1] != 0 && results[3] != 0 && results[2] > results[0]) {
+                auto const period_ns = static_cast<double>(daxa_device.properties().limits.timestamp_period);
+                last_gpu_ms = static_cast<double>(results[2] - results[0]) * period_ns * 1e-6;
+                changed = dynamic_resolution.update(last_gpu_ms);
             }
         }
     }
+    if (changed) {
+        // Resampling keeps feedback buffers lined up with the new scale.
+        resize_copy_stretch = true;
+        auto const old_width = gpu_input.Resolution.x;
+        auto const old_height = gpu_input.Resolution.y;
+        set_viewport_size(display_size);
+        // Keep the mouse where it was on screen. Negative z and w mean the button is up. Both axes
+        // are rounded to whole pixels separately, so they get a ratio each.
+        auto const ratio_x = gpu_input.Resolution.x / old_width;
+        auto const ratio_y = gpu_input.Resolution.y / old_height;
+        mouse_pos.x *= ratio_x;
+        mouse_pos.y *= ratio_y;
+        gpu_input.Mouse.x *= ratio_x;
+        gpu_input.Mouse.y *= ratio_y;
+        if (gpu_input.Mouse.z >= 0.0f) {
+            gpu_input.Mouse.z *= ratio_x;
+            gpu_input.Mouse.w *= ratio_y;
+        }
+    }
+    return changed;
+}
 
-    first_record_after_load = false;
+void Viewport::read_gpu_timings() {
+    // The same slot update_render_scale() reads, so it's finished too.
+    gpu_profiler.read_back((upload_ring_slot + 1) % frames_in_flight);
+}
 
-    return viewport_render_image;
+auto Viewport::can_render_direct(daxa::Format format) const -> bool {
+    // Nothing samples the image pass, so unless it needs mips it can go straight to the target.
+    return image_pass.swapchain_pipeline && image_pass.swapchain_pipeline->is_valid() &&
+           image_pass.swapchain_pipeline->info().color_attachments.at(0).format == format &&
+           !image_pass.needs_mipmap;
 }
 
 void Viewport::reset() {
@@ -637,8 +1435,10 @@ void Viewport::reset() {
 }
 
 void Viewport::on_mouse_move(float px, float py) {
-    mouse_pos.x = px;
-    mouse_pos.y = gpu_input.Resolution.y - py - 1.0f;
+    // Window coordinates are in display pixels, the shader sees render pixels.
+    auto const scale = display_size.x > 0.0f ? gpu_input.Resolution.x / display_size.x : 1.0f;
+    mouse_pos.x = px * scale;
+    mouse_pos.y = gpu_input.Resolution.y - py * scale - 1.0f;
     if (mouse_enabled) {
         gpu_input.Mouse.x = mouse_pos.x;
         gpu_input.Mouse.y = mouse_pos.y;
@@ -700,6 +1500,7 @@ void Viewport::on_key(int32_t key_id, int32_t action) {
     }
 
     keyboard_input.current_state[static_cast<size_t>(transformed_key_id)] = static_cast<int8_t>(action != GLFW_RELEASE);
+    keyboard_dirty = true;
     if (action == GLFW_PRESS) {
         keyboard_input.keypress[static_cast<size_t>(transformed_key_id)] = 1;
         keyboard_input.toggles[static_cast<size_t>(transformed_key_id)] = 1 - keyboard_input.toggles[static_cast<size_t>(transformed_key_id)];
@@ -721,231 +1522,176 @@ void Viewport::on_toggle_pause(bool is_paused) {
     }
 }
 
-auto Viewport::load_texture(std::string path) -> std::pair<daxa::ImageId, size_t> {
-    auto task_image_index = task_textures.size();
-    int32_t size_x = 0;
-    int32_t size_y = 0;
-    int32_t channel_n = 0;
-    auto task_image = daxa::TaskImage({.name = path});
-    replace_all(path, "/media/a/", "media/images/");
-    stbi_set_flip_vertically_on_load(1);
-    auto *stb_data = stbi_load(path.c_str(), &size_x, &size_y, &channel_n, 4);
-    auto *temp_data = stb_data;
-    auto *heap_data = (stbi_uc *)nullptr;
-    auto temp_format = daxa::Format::R8G8B8A8_UNORM;
-    auto pixel_size_bytes = 4;
-    if (stb_data == nullptr) {
-        // check if the file exists at all, allowing people to load a file to binary data
-        auto file = std::ifstream{path, std::ios::binary};
-        if (file.good()) {
-            auto size = std::filesystem::file_size(path);
-            pixel_size_bytes = 16;
-            size = (size + pixel_size_bytes - 1) & ~(pixel_size_bytes - 1);
-            size_x = std::min<int>(size / pixel_size_bytes, 1024);
-            size_y = (size / pixel_size_bytes + 1023) / 1024;
-            heap_data = new stbi_uc[size_x * size_y * pixel_size_bytes];
-            file.read(reinterpret_cast<char *>(heap_data), static_cast<std::streamsize>(size));
-            temp_data = heap_data;
-            temp_format = daxa::Format::R32G32B32A32_UINT;
-        } else {
-            temp_format = daxa::Format::UNDEFINED;
-        }
+void Viewport::stage_textures(std::shared_ptr<ShaderLoad> const &load) {
+    auto staging_size = size_t{};
+    for (auto &upload : load->texture_uploads) {
+        upload.source.staging_offset = staging_size;
+        staging_size += staged_stride_bytes(upload.source);
     }
-    auto image_id = daxa_device.create_image({
-        .dimensions = 2,
-        .format = temp_format,
-        .size = {static_cast<uint32_t>(size_x), static_cast<uint32_t>(size_y), 1},
-        .usage = daxa::ImageUsageFlagBits::TRANSFER_DST | daxa::ImageUsageFlagBits::SHADER_SAMPLED,
-        .name = "texture",
-    });
-    task_image.set_images({.images = std::array{image_id}});
-
-    daxa::TaskGraph temp_task_graph = daxa::TaskGraph({
-        .device = daxa_device,
-        .name = "temp_task_graph",
-    });
-    temp_task_graph.use_persistent_image(task_image);
-    temp_task_graph.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_image),
-        },
-        .task = [this, temp_data, size_x, size_y, image_id, pixel_size_bytes](daxa::TaskInterface task_runtime) {
-            auto staging_buffer = daxa_device.create_buffer({
-                .size = static_cast<uint32_t>(size_x * size_y * pixel_size_bytes),
-                .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                .name = "staging_buffer",
-            });
-            auto *buffer_ptr = daxa_device.buffer_host_address_as<uint8_t>(staging_buffer).value();
-            memcpy(buffer_ptr, temp_data, size_x * size_y * pixel_size_bytes);
-            auto &cmd_list = task_runtime.recorder;
-            cmd_list.pipeline_barrier({
-                .dst_access = daxa::AccessConsts::TRANSFER_WRITE,
-            });
-            cmd_list.destroy_buffer_deferred(staging_buffer);
-            cmd_list.copy_buffer_to_image({
-                .buffer = staging_buffer,
-                .image = image_id,
-                .image_extent = {static_cast<uint32_t>(size_x), static_cast<uint32_t>(size_y), 1},
-            });
-        },
-        .name = "upload_user_texture",
-    });
-    temp_task_graph.submit({});
-    temp_task_graph.complete({});
-    temp_task_graph.execute({});
-    task_textures.push_back(task_image);
-    if (stb_data != nullptr) {
-        stbi_image_free(temp_data);
+    if (staging_size == 0) {
+        return;
+    }
+    load->texture_staging_buffer = daxa_device.create_buffer({
+        .size = static_cast<uint32_t>(staging_size),
+        .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_SEQUENTIAL_WRITE,
+        .name = "texture_staging_buffer",
+    });
+    auto *staging_ptr = daxa_device.buffer_host_address_as<uint8_t>(load->texture_staging_buffer).value();
+    // Every job decodes its texture straight into the arena. The uploads aren't touched again
+    // until all jobs are done, so the workers can write to them. The decodes aren't skipped when
+    // the load is cancelled, as newer loads share its textures.
+    auto const decode_t0 = Clock::now();
+    load->texture_decodes_remaining = load->texture_uploads.size();
+    load->jobs_remaining += load->texture_uploads.size();
+    for (auto &upload : load->texture_uploads) {
+        thread_pool.enqueue([load, &upload, staging_ptr, decode_t0]() {
+            upload.source.decoded = decode_texture(upload.path, upload.kind, upload.source, staging_ptr + upload.source.staging_offset);
+            if (load->texture_decodes_remaining.fetch_sub(1) == 1) {
+                load->texture_decode_ms = std::chrono::duration<double, std::milli>(Clock::now() - decode_t0).count();
+                load->texture_decodes_remaining.notify_all();
+            }
+            if (load->jobs_remaining.fetch_sub(1) == 1) {
+                load->jobs_remaining.notify_all();
+            }
+        });
     }
-    if (heap_data != nullptr) {
-        delete[] heap_data;
+}
+
+auto Viewport::load_texture(ShaderLoad &load, std::string path) -> std::pair<daxa::ImageId, size_t> {
+    auto task_image_index = task_textures.size();
+    auto task_image = daxa::TaskImage({.name = path});
+    replace_all(path, "/media/a/", "media/images/");
+    auto image = probe_texture(path, TextureSourceKind::TEXTURE);
+    auto image_id = daxa_device.create_image({
+        .dimensions = 2,
+        .format = image.format,
+        .size = {image.size.x, image.size.y, 1},
+        .usage = daxa::ImageUsageFlagBits::TRANSFER_DST | daxa::ImageUsageFlagBits::SHADER_SAMPLED,
+        .name = "texture",
+    });
+    task_image.set_images({.images = std::array{image_id}});
+    if (image.format != daxa::Format::UNDEFINED) {
+        load.texture_uploads.push_back({.image = image_id, .path = path, .kind = TextureSourceKind::TEXTURE, .source = image});
+        load.texture_upload_images.emplace_back(task_image, 1);
     }
+    task_textures.push_back(task_image);
     return std::pair<daxa::ImageId, size_t>{image_id, task_image_index};
 }
 
-auto Viewport::load_cube_texture(std::string path) -> std::pair<daxa::ImageId, size_t> {
+auto Viewport::load_cube_texture(ShaderLoad &load, std::string path) -> std::pair<daxa::ImageId, size_t> {
     auto task_image_index = task_textures.size();
-    int32_t size_x = 0;
-    int32_t size_y = 0;
-    int32_t channel_n = 0;
     auto task_image = daxa::TaskImage({.name = path});
     replace_all(path, "/media/a/", "media/images/");
-    stbi_set_flip_vertically_on_load(0);
-    auto *temp_data = stbi_load(path.c_str(), &size_x, &size_y, &channel_n, 4);
+    auto faces = std::array<DecodedImage, 6>{};
+    auto const face_paths = cube_face_paths(path);
+    for (uint32_t i = 0; i < 6; ++i) {
+        faces[i] = probe_texture(face_paths[i], TextureSourceKind::CUBE_FACE);
+    }
+    auto const size_x = faces[0].size.x;
+    auto const size_y = faces[0].size.y;
     auto image_id = daxa_device.create_image({
         .dimensions = 2,
         .format = daxa::Format::R8G8B8A8_UNORM,
-        .size = {static_cast<uint32_t>(size_x), static_cast<uint32_t>(size_y), 1},
+        .size = {size_x, size_y, 1},
         .array_layer_count = 6,
         .usage = daxa::ImageUsageFlagBits::TRANSFER_DST | daxa::ImageUsageFlagBits::SHADER_SAMPLED,
         .name = "cube texture",
     });
     task_image.set_images({.images = std::array{image_id}});
-    daxa::TaskGraph temp_task_graph = daxa::TaskGraph({
-        .device = daxa_device,
-        .name = "temp_task_graph",
-    });
-    temp_task_graph.use_persistent_image(task_image);
-    auto loaded_buffers = std::vector<stbi_uc *>{};
-    loaded_buffers.reserve(6);
-    loaded_buffers.push_back(temp_data);
-    for (uint32_t i = 1; i < 6; ++i) {
-        auto temp_path = std::filesystem::path(path);
-        auto new_path = temp_path.parent_path() / std::filesystem::path(temp_path.stem().string() + "_" + std::to_string(i) + temp_path.extension().string());
-        auto *temp_data = stbi_load(new_path.string().c_str(), &size_x, &size_y, &channel_n, 4);
-        loaded_buffers.push_back(temp_data);
-    }
+    auto any_face_uploaded = false;
     for (uint32_t i = 0; i < 6; ++i) {
-        temp_task_graph.add_task({
-            .attachments = {
-                daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_image),
-            },
-            .task = [this, &loaded_buffers, size_x, size_y, image_id, i](daxa::TaskInterface task_runtime) {
-                auto staging_buffer = daxa_device.create_buffer({
-                    .size = static_cast<uint32_t>(size_x * size_y * 4),
-                    .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                    .name = "staging_buffer",
-                });
-                auto *buffer_ptr = daxa_device.buffer_host_address_as<uint8_t>(staging_buffer).value();
-                memcpy(buffer_ptr, loaded_buffers[i], size_x * size_y * 4);
-                auto &cmd_list = task_runtime.recorder;
-                cmd_list.pipeline_barrier({
-                    .dst_access = daxa::AccessConsts::TRANSFER_WRITE,
-                });
-                cmd_list.destroy_buffer_deferred(staging_buffer);
-                cmd_list.copy_buffer_to_image({
-                    .buffer = staging_buffer,
-                    .image = image_id,
-                    .image_slice = {
-                        .base_array_layer = i,
-                    },
-                    .image_extent = {static_cast<uint32_t>(size_x), static_cast<uint32_t>(size_y), 1},
-                });
-            },
-            .name = "upload_user_texture",
-        });
+        // A face that can't be read, or doesn't match the first one's size, is left undefined.
+        if (faces[i].format == daxa::Format::UNDEFINED || faces[i].size.x != size_x || faces[i].size.y != size_y) {
+            continue;
+        }
+        load.texture_uploads.push_back({.image = image_id, .array_layer = i, .path = face_paths[i], .kind = TextureSourceKind::CUBE_FACE, .source = faces[i]});
+        any_face_uploaded = true;
     }
-    temp_task_graph.submit({});
-    temp_task_graph.complete({});
-    temp_task_graph.execute({});
-    task_textures.push_back(task_image);
-    for (auto *loaded_buffer_ptr : loaded_buffers) {
-        stbi_image_free(loaded_buffer_ptr);
+    if (any_face_uploaded) {
+        load.texture_upload_images.emplace_back(task_image, 6);
     }
+    task_textures.push_back(task_image);
     return std::pair<daxa::ImageId, size_t>{image_id, task_image_index};
 }
 
-auto Viewport::load_volume_texture(std::string id) -> std::pair<daxa::ImageId, size_t> {
+auto Viewport::load_volume_texture(ShaderLoad &load, std::string id) -> std::pair<daxa::ImageId, size_t> {
     auto task_image_index = task_textures.size();
-
-    auto num_channels = uint32_t{4};
-    if (id == "4sfGRr") {
-        num_channels = 1;
-    }
-
-    auto random_numbers = std::vector<uint8_t>{};
-    random_numbers.resize(32 * 32 * 32 * num_channels);
-
-    auto rng = std::mt19937_64(std::hash<std::string>{}(id));
-    auto dist = std::uniform_int_distribution<std::mt19937::result_type>(0, 255);
-    for (auto &num : random_numbers) {
-        num = dist(rng) & 0xff;
-    }
-
-    auto const *name = num_channels == 1 ? "gray_rnd_volume" : "rgba_rnd_volume";
+    auto volume = probe_texture(id, TextureSourceKind::VOLUME);
+    auto const *name = volume.pixel_size_bytes == 1 ? "gray_rnd_volume" : "rgba_rnd_volume";
 
     auto task_image = daxa::TaskImage({.name = name});
     auto image_id = daxa_device.create_image({
         .dimensions = 3,
-        .format = num_channels == 1 ? daxa::Format::R8_UNORM : daxa::Format::R8G8B8A8_UNORM,
-        .size = {32, 32, 32},
+        .format = volume.format,
+        .size = {volume.size.x, volume.size.y, volume.size.z},
         .usage = daxa::ImageUsageFlagBits::TRANSFER_DST | daxa::ImageUsageFlagBits::SHADER_SAMPLED,
         .name = name,
     });
     task_image.set_images({.images = std::array{image_id}});
+    load.texture_uploads.push_back({.image = image_id, .path = id, .kind = TextureSourceKind::VOLUME, .source = volume});
+    load.texture_upload_images.emplace_back(task_image, 1);
+    task_textures.push_back(task_image);
+
+    return std::pair<daxa::ImageId, size_t>{image_id, task_image_index};
+}
+
+void Viewport::flush_texture_uploads(ShaderLoad &load) {
+    auto staging_buffer = std::exchange(load.texture_staging_buffer, daxa::BufferId{});
+    auto uploads = std::exchange(load.texture_uploads, {});
+    auto upload_images = std::exchange(load.texture_upload_images, {});
+    // Textures whose file couldn't be decoded keep undefined contents.
+    std::erase_if(uploads, [](TextureUpload const &upload) { return !upload.source.decoded; });
+    if (uploads.empty()) {
+        if (!staging_buffer.is_empty()) {
+            daxa_device.destroy_buffer(staging_buffer);
+        }
+        return;
+    }
 
     daxa::TaskGraph temp_task_graph = daxa::TaskGraph({
         .device = daxa_device,
-        .name = "temp_task_graph",
+        .name = "texture_upload_task_graph",
     });
-    temp_task_graph.use_persistent_image(task_image);
+    auto attachments = std::vector<daxa::TaskAttachmentInfo>{};
+    for (auto const &[task_image, layer_count] : upload_images) {
+        temp_task_graph.use_persistent_image(task_image);
+        attachments.push_back(daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_image.view().view({.layer_count = layer_count})));
+    }
     temp_task_graph.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_image),
-        },
-        .task = [this, &random_numbers, image_id](daxa::TaskInterface task_runtime) {
-            auto staging_buffer = daxa_device.create_buffer({
-                .size = static_cast<uint32_t>(random_numbers.size()),
-                .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
-                .name = "staging_buffer",
-            });
-            auto *buffer_ptr = daxa_device.buffer_host_address_as<uint8_t>(staging_buffer).value();
-            memcpy(buffer_ptr, random_numbers.data(), random_numbers.size());
+        .attachments = attachments,
+        .task = [&uploads, staging_buffer](daxa::TaskInterface task_runtime) {
             auto &cmd_list = task_runtime.recorder;
-            cmd_list.pipeline_barrier({
-                .dst_access = daxa::AccessConsts::TRANSFER_WRITE,
-            });
+            for (auto const &upload : uploads) {
+                cmd_list.copy_buffer_to_image({
+                    .buffer = staging_buffer,
+                    .buffer_offset = upload.source.staging_offset,
+                    .image = upload.image,
+                    .image_slice = {
+                        .base_array_layer = upload.array_layer,
+                    },
+                    .image_extent = {upload.source.size.x, upload.source.size.y, upload.source.size.z},
+                });
+            }
             cmd_list.destroy_buffer_deferred(staging_buffer);
-            cmd_list.copy_buffer_to_image({
-                .buffer = staging_buffer,
-                .image = image_id,
-                .image_extent = {32, 32, 32},
-            });
         },
-        .name = "upload_user_texture",
+        .name = "upload_user_textures",
     });
     temp_task_graph.submit({});
     temp_task_graph.complete({});
     temp_task_graph.execute({});
-    task_textures.push_back(task_image);
-
-    return std::pair<daxa::ImageId, size_t>{image_id, task_image_index};
 }
 
 void Viewport::load_shadertoy_json(nlohmann::json json) {
+    auto const load_start_time = Clock::now();
     this->load_failed = false;
     auto &renderpasses = json["renderpass"];
 
+    for (auto &renderpass : renderpasses) {
+        if (renderpass["code"].is_string()) {
+            unescape_shader_code(renderpass["code"].get_ref<std::string &>());
+        }
+    }
+
     auto id_map = std::unordered_map<std::string, ShaderPassInput>{};
 
     auto buffer_pass_n = size_t{};
@@ -970,23 +1716,54 @@ void Viewport::load_shadertoy_json(nlohmann::json json) {
         }
     }
 
-    std::vector<ShaderBufferPass> new_buffer_passes{};
-    std::vector<ShaderCubePass> new_cube_passes{};
-    ShaderBufferPass new_image_pass{};
+    // Macros from the common code are expanded in the passes, so its channels count for all of them.
+    auto const common_channels = referenced_channels(common_code);
 
-    new_buffer_passes.reserve(buffer_pass_n);
-    new_cube_passes.reserve(cube_pass_n);
-    replace_all(common_code, "\\n", "\n");
-    pipeline_manager.add_virtual_file(daxa::VirtualFileInfo{
+    auto common_file = daxa::VirtualFileInfo{
         .name = "common",
         .contents = common_code,
-    });
+    };
 
     auto user_code = daxa::VirtualFileInfo{
         .name = "user_code",
         .contents = "#pragma once\n",
     };
 
+    auto load = std::make_shared<ShaderLoad>();
+    load->start_time = load_start_time;
+
+    // A newer edit replaces whatever is still compiling. Jobs that haven't started yet will skip
+    // their work, so they don't hold up the jobs queued behind them.
+    if (pending_load) {
+        pending_load->cancelled = true;
+        load->previous_load = pending_load->texture_uploads.empty() ? pending_load->previous_load : pending_load;
+    }
+
+    // If setting up the passes throws, for example on a malformed input, the textures created for
+    // this load would never be staged or uploaded. They are destroyed instead of staying cached.
+    auto const first_new_texture = task_textures.size();
+    auto texture_guard = ScopeGuard{[this, first_new_texture]() {
+        std::erase_if(loaded_textures, [&](auto const &entry) {
+            if (entry.second.second < first_new_texture) {
+                return false;
+            }
+            daxa_device.destroy_image(entry.second.first);
+            return true;
+        });
+        task_textures.erase(task_textures.begin() + static_cast<std::ptrdiff_t>(first_new_texture), task_textures.end());
+    }};
+
+    auto parsed_inputs = std::vector<std::vector<ParsedPassInput>>{};
+    for (auto &renderpass : renderpasses) {
+        auto &pass_type = renderpass["type"];
+        auto &pass_inputs = parsed_inputs.emplace_back();
+        if (pass_type != "image" && pass_type != "buffer" && pass_type != "cubemap") {
+            continue;
+        }
+        auto const used_channels = common_channels | referenced_channels(renderpass["code"].get<std::string>());
+        pass_inputs = parse_pass_inputs(renderpass["inputs"], used_channels, id_map);
+    }
+
     auto pass_i = size_t{0};
     for (auto &renderpass : renderpasses) {
         ++pass_i;
@@ -1002,7 +1779,9 @@ void Viewport::load_shadertoy_json(nlohmann::json json) {
         user_code.contents += "#include <" + pipeline_name + ">\n";
         user_code.contents += "#endif\n";
     }
-    pipeline_manager.add_virtual_file(user_code);
+
+    auto compile_jobs = std::vector<ShaderPassCompileJob>{};
+    compile_jobs.reserve(renderpasses.size());
 
     pass_i = size_t{0};
     for (auto &renderpass : renderpasses) {
@@ -1020,6 +1799,8 @@ void Viewport::load_shadertoy_json(nlohmann::json json) {
         }
 
         auto temp_inputs = std::vector<ShaderPassInput>{};
+        auto unused_channels = uint32_t{};
+        auto texture_ms = 0.0;
 
         auto pass_inputs_file = daxa::VirtualFileInfo{
             .name = pipeline_name + "_inputs",
@@ -1074,73 +1855,50 @@ void Viewport::load_shadertoy_json(nlohmann::json json) {
         pass_inputs_file.contents += "#define iChannel2 CombinedImageSampler2D(daxa_push_constant.input_images.Channel[2], daxa_push_constant.input_images.Channel_sampler[2], 0)\n";
         pass_inputs_file.contents += "#define iChannel3 CombinedImageSampler2D(daxa_push_constant.input_images.Channel[3], daxa_push_constant.input_images.Channel_sampler[3], 0)\n";
 
-        for (auto &input : inputs) {
-            auto type = std::string{};
-            if (input.contains("type")) {
-                type = input["type"];
-            } else if (input.contains("ctype")) {
-                type = input["ctype"];
-            } else {
-                // 😐
-                continue;
-            }
-
-            auto channel_str = std::to_string(uint32_t{input["channel"]});
+        for (auto const &parsed : parsed_inputs[pass_i - 1]) {
+            auto &input = *parsed.json;
+            auto const &type = parsed.type;
+            auto channel_str = std::to_string(parsed.channel);
             auto image_type = type_json_to_glsl_image_type(type);
             auto extra = type_json_to_glsl_image_type_extra(type);
 
-            // Skip unsupported input types
-            if (type != "image" && type != "buffer" && type != "cubemap" && type != "texture" && type != "keyboard" && type != "volume") {
+            // Channels the code never mentions are neither loaded nor bound.
+            if (!parsed.used) {
+                ++unused_channels;
                 continue;
             }
 
-            auto load_texture_type = [&](ShaderPassInputType texture_input_type, std::pair<daxa::ImageId, size_t> (*load_function)(void *, std::string const &)) {
-                auto input_copy = ShaderPassInput{
-                    .type = texture_input_type,
-                    .channel = input["channel"],
-                    .sampler = get_sampler(samplers, input),
-                };
-                // TEMPORARY HACK
-                if (input_copy.sampler == samplers[static_cast<size_t>(ShaderToyFilter::MIPMAP) + static_cast<size_t>(ShaderToyWrap::CLAMP) * 3]) {
-                    input_copy.sampler = samplers[static_cast<size_t>(ShaderToyFilter::LINEAR) + static_cast<size_t>(ShaderToyWrap::CLAMP) * 3];
-                }
-                if (input_copy.sampler == samplers[static_cast<size_t>(ShaderToyFilter::MIPMAP) + static_cast<size_t>(ShaderToyWrap::REPEAT) * 3]) {
-                    input_copy.sampler = samplers[static_cast<size_t>(ShaderToyFilter::LINEAR) + static_cast<size_t>(ShaderToyWrap::REPEAT) * 3];
-                }
-                auto filepath = std::string{};
-                auto path = std::string{};
-                if (texture_input_type == ShaderPassInputType::VOLUME_TEXTURE) {
-                    path = nlohmann::to_string(input["id"]);
-                    replace_all(path, "\"", "");
-                } else if (input.contains("filepath")) {
-                    path = std::string{input["filepath"]};
-                } else if (input.contains("src")) {
-                    path = std::string{input["src"]};
-                } else {
-                    // 😐
-                    return;
-                }
-                if (loaded_textures.contains(path)) {
-                    auto &[loaded_texture, task_image_index] = loaded_textures.at(path);
-                    input_copy.index = task_image_index;
-                } else {
-                    auto loaded_result = load_function(this, path);
-                    loaded_textures[path] = loaded_result;
-                    auto &[loaded_texture, task_image_index] = loaded_result;
-                    input_copy.index = task_image_index;
+            if (parsed.texture_type != ShaderPassInputType::NONE) {
+                if (!parsed.texture_key.empty()) {
+                    auto input_copy = ShaderPassInput{
+                        .type = parsed.texture_type,
+                        .channel = parsed.channel,
+                        .sampler = get_sampler(samplers, input),
+                    };
+                    // TEMPORARY HACK
+                    if (input_copy.sampler == samplers[static_cast<size_t>(ShaderToyFilter::MIPMAP) + static_cast<size_t>(ShaderToyWrap::CLAMP) * 3]) {
+                        input_copy.sampler = samplers[static_cast<size_t>(ShaderToyFilter::LINEAR) + static_cast<size_t>(ShaderToyWrap::CLAMP) * 3];
+                    }
+                    if (input_copy.sampler == samplers[static_cast<size_t>(ShaderToyFilter::MIPMAP) + static_cast<size_t>(ShaderToyWrap::REPEAT) * 3]) {
+                        input_copy.sampler = samplers[static_cast<size_t>(ShaderToyFilter::LINEAR) + static_cast<size_t>(ShaderToyWrap::REPEAT) * 3];
+                    }
+                    auto const &path = parsed.texture_key;
+                    if (!loaded_textures.contains(path)) {
+                        auto const texture_t0 = Clock::now();
+                        switch (parsed.texture_type) {
+                        case ShaderPassInputType::TEXTURE: loaded_textures[path] = load_texture(*load, path); break;
+                        case ShaderPassInputType::CUBE_TEXTURE: loaded_textures[path] = load_cube_texture(*load, path); break;
+                        default: loaded_textures[path] = load_volume_texture(*load, path); break;
+                        }
+                        texture_ms += std::chrono::duration<double, std::milli>(Clock::now() - texture_t0).count();
+                    }
+                    input_copy.index = loaded_textures.at(path).second;
+                    temp_inputs.push_back(input_copy);
                 }
-                temp_inputs.push_back(input_copy);
-            };
-
-            auto id = nlohmann::to_string(input["id"]);
-            replace_all(id, "\"", "");
-
-            if (type == "cubemap" && !id_map.contains(id)) {
-                load_texture_type(ShaderPassInputType::CUBE_TEXTURE, [](void *self, std::string const &path) { return static_cast<Viewport *>(self)->load_cube_texture(path); });
             } else if (type == "buffer" || type == "cubemap") {
-                if (id_map.contains(id)) {
-                    auto input_copy = id_map[id];
-                    input_copy.channel = input["channel"];
+                if (id_map.contains(parsed.id)) {
+                    auto input_copy = id_map[parsed.id];
+                    input_copy.channel = parsed.channel;
                     input_copy.sampler = get_sampler(samplers, input);
                     temp_inputs.push_back(input_copy);
                 } else {
@@ -1149,13 +1907,9 @@ void Viewport::load_shadertoy_json(nlohmann::json json) {
             } else if (type == "keyboard") {
                 temp_inputs.push_back({
                     .type = ShaderPassInputType::KEYBOARD,
-                    .channel = input["channel"],
+                    .channel = parsed.channel,
                     .sampler = get_sampler(samplers, input),
                 });
-            } else if (type == "texture") {
-                load_texture_type(ShaderPassInputType::TEXTURE, [](void *self, std::string const &path) { return static_cast<Viewport *>(self)->load_texture(path); });
-            } else if (type == "volume") {
-                load_texture_type(ShaderPassInputType::VOLUME_TEXTURE, [](void *self, std::string const &id) { return static_cast<Viewport *>(self)->load_volume_texture(id); });
             }
             pass_inputs_file.contents += std::string{"#undef iChannel"} + channel_str + "\n" + std::string{"#define iChannel"} + channel_str + " " + image_type + "(daxa_push_constant.input_images.Channel[" + channel_str + "], daxa_push_constant.input_images.Channel_sampler[" + channel_str + "]" + extra + ")\n";
         }
@@ -1165,62 +1919,459 @@ void Viewport::load_shadertoy_json(nlohmann::json json) {
             .contents = code,
         };
 
-        replace_all(pass_file.contents, "\\n", "\n");
-        pipeline_manager.add_virtual_file(pass_file);
-        pipeline_manager.add_virtual_file(pass_inputs_file);
-
         auto extra_defines = std::vector<daxa::ShaderDefine>{};
         auto pass_format = daxa::Format::R32G32B32A32_SFLOAT;
+        auto cube_size = DEFAULT_CUBE_SIZE;
         if (pass_type == "image") {
             pass_format = daxa::Format::R16G16B16A16_SFLOAT;
             extra_defines.push_back({.name = "MAIN_IMAGE", .value = "1"});
         } else if (pass_type == "cubemap") {
             pass_format = daxa::Format::R16G16B16A16_SFLOAT;
+            if (renderpass.contains("cube_format")) {
+                auto const &format_json = renderpass["cube_format"];
+                if (auto format = format_json.is_string() ? parse_cube_format(format_json.get<std::string>()) : std::nullopt) {
+                    pass_format = *format;
+                } else {
+                    core::log_error("Unknown cube_format " + nlohmann::to_string(format_json) + " in pass " + pipeline_name + ", expected rgba8, rgba16f or rgba32f");
+                }
+            }
+            if (renderpass.contains("cube_size")) {
+                auto const &size_json = renderpass["cube_size"];
+                auto const size = size_json.is_number_integer() ? size_json.get<int64_t>() : int64_t{0};
+                if (size >= MIN_CUBE_SIZE && size <= MAX_CUBE_SIZE) {
+                    cube_size = static_cast<uint32_t>(size);
+                } else {
+                    core::log_error("Invalid cube_size " + nlohmann::to_string(size_json) + " in pass " + pipeline_name + ", expected an integer from " + std::to_string(MIN_CUBE_SIZE) + " to " + std::to_string(MAX_CUBE_SIZE));
+                }
+            }
             extra_defines.push_back({.name = "CUBEMAP", .value = "1"});
+            extra_defines.push_back({.name = "CUBEMAP_SIZE", .value = std::to_string(cube_size)});
         }
         extra_defines.push_back({.name = "_DESKTOP_SHADERTOY_USER_PASS" + std::to_string(pass_i), .value = "1"});
 
-        const auto shader_include_dir = resource_dir / std::filesystem::path("src");
-        auto compile_result = pipeline_manager.add_raster_pipeline({
-            .vertex_shader_info = daxa::ShaderCompileInfo{
-                .source = daxa::ShaderFile{shader_include_dir / "app/viewport.glsl"},
-                .compile_options{
-                    .root_paths = {shader_include_dir},
-                    .defines = extra_defines,
-                },
+        compile_jobs.push_back({
+            .name = pipeline_name,
+            .type = std::string{pass_type},
+            .inputs = std::move(temp_inputs),
+            .code_file = std::move(pass_file),
+            .inputs_file = std::move(pass_inputs_file),
+            .defines = std::move(extra_defines),
+            .format = pass_format,
+            .cube_size = cube_size,
+            .timings = {.name = pipeline_name, .unused_channels = unused_channels, .texture_ms = texture_ms},
+        });
+    }
+
+    const auto shader_include_dir = resource_dir / std::filesystem::path("src");
+
+    if (json.contains("info") && json["info"].contains("id") && json["info"]["id"].is_string()) {
+        load->shader_id = std::string{json["info"]["id"]};
+    }
+    load->compile_jobs = std::move(compile_jobs);
+    load->common_file = std::move(common_file);
+    load->user_code = std::move(user_code);
+
+    // Everything outside of the per-pass files that ends up in the SPIR-V: the glslang build and
+    // every header viewport.glsl can include. Bump the version string whenever the compile settings
+    // in compile_glsl() or shader_preprocess() change.
+    load->optimization = spirv_optimization;
+    load->swapchain_format = swapchain_format;
+    load->shared_cache_key.append("desktop-shadertoy-spirv-7");
+    load->shared_cache_key.append(glslang_version_string());
+    load->shared_cache_key.append(std::to_string(static_cast<uint32_t>(load->optimization)));
+    // Only the contents, so the key doesn't depend on where the app is installed.
+    for (auto const &include_file : collect_include_files(shader_include_dir / "app/viewport.glsl", shader_root_paths(shader_include_dir))) {
+        load->shared_cache_key.append(include_file.second);
+    }
+    // The vertex stage doesn't see any user code, so all passes share it.
+    load->vertex_cache_key = load->shared_cache_key;
+    load->vertex_cache_key.append("vertex");
+    load->shared_cache_key.append(load->common_file.contents);
+
+    auto live_pipeline = [this](ShaderPassCompileJob &job) -> std::shared_ptr<daxa::RasterPipeline> {
+        auto matches = [&](auto const &pass) {
+            return pass.pipeline && pass.name == job.name && pass.source_hash == job.cache_key.hash;
+        };
+        auto reuse = [&](auto const &pass) {
+            job.reads_frame_inputs = pass.reads_frame_inputs;
+            return pass.pipeline;
+        };
+        if (job.type == "image" && matches(image_pass)) {
+            return reuse(image_pass);
+        }
+        if (job.type == "buffer") {
+            for (auto const &pass : buffer_passes) {
+                if (matches(pass)) {
+                    return reuse(pass);
+                }
+            }
+        }
+        if (job.type == "cubemap") {
+            for (auto const &pass : cube_passes) {
+                if (matches(pass)) {
+                    return reuse(pass);
+                }
+            }
+        }
+        return nullptr;
+    };
+
+    // Only passes whose code, common code or channel types changed need a new pipeline.
+    auto dirty_jobs = std::vector<ShaderPassCompileJob *>{};
+    for (auto &job : load->compile_jobs) {
+        job.cache_key = load->shared_cache_key;
+        job.cache_key.append(job.name);
+        job.cache_key.append(job.inputs_file.contents);
+        job.cache_key.append(job.code_file.contents);
+        for (auto const &define : job.defines) {
+            job.cache_key.append(define.name);
+            job.cache_key.append(define.value);
+        }
+        // The pipeline is built for the output format, which cube passes can change.
+        job.cache_key.append(std::to_string(static_cast<uint32_t>(job.format)));
+        job.pipeline = live_pipeline(job);
+        if (job.type == "image" && job.pipeline) {
+            job.swapchain_pipeline = image_pass.swapchain_pipeline;
+        }
+        job.timings.reused = job.pipeline != nullptr;
+        if (!job.pipeline) {
+            dirty_jobs.push_back(&job);
+        }
+    }
+
+    // Decode the new textures and compile the dirty passes on the thread pool. The result is picked
+    // up by update_load() at a frame boundary.
+    load->jobs_remaining = dirty_jobs.size();
+    stage_textures(load);
+    pending_load = load;
+    texture_guard.dismissed = true;
+
+    for (auto *job_ptr : dirty_jobs) {
+        auto &job = *job_ptr;
+        thread_pool.enqueue([this, load, &job]() {
+            if (!load->cancelled) {
+                compile_pass(*load, job);
+            }
+            if (load->jobs_remaining.fetch_sub(1) == 1) {
+                load->jobs_remaining.notify_all();
+            }
+        });
+    }
+}
+
+void Viewport::compile_pass(ShaderLoad &load, ShaderPassCompileJob &job) {
+    const auto shader_include_dir = resource_dir / std::filesystem::path("src");
+
+    auto compile_stage = [&](ShaderStage stage, SpirvCacheKey const &cache_key, std::vector<daxa::VirtualFileInfo const *> virtual_files, std::vector<daxa::ShaderDefine> defines) -> GlslCompileResult {
+        if (auto cached_spirv = spirv_cache.load(cache_key)) {
+            if (stage == ShaderStage::FRAGMENT) {
+                job.timings.spirv_cached = true;
+            }
+            return GlslCompileResult{.spirv = std::move(*cached_spirv)};
+        }
+        auto result = compile_glsl({
+            .source_path = shader_include_dir / "app/viewport.glsl",
+            .stage = stage,
+            .root_paths = shader_root_paths(shader_include_dir),
+            .virtual_files = std::move(virtual_files),
+            .defines = std::move(defines),
+            .custom_preprocessor = shader_preprocess,
+            .name = job.name,
+            .include_cache = &load.include_cache,
+            .optimization = load.optimization,
+        });
+        if (result.error.empty()) {
+            spirv_cache.store(cache_key, result.spirv);
+        }
+        return result;
+    };
+
+    auto add_compile_timings = [&](GlslCompileResult const &result) {
+        job.timings.preprocess_ms += result.preprocess_ms;
+        job.timings.parse_ms += result.parse_ms;
+        job.timings.spirv_ms += result.spirv_ms;
+        job.timings.optimize_ms += result.optimize_ms;
+    };
+
+    // Whichever job gets here first compiles the vertex stage for everyone else, and is billed for it.
+    std::call_once(load.vertex_once, [&]() {
+        load.vertex_result = compile_stage(ShaderStage::VERTEX, load.vertex_cache_key, {}, {});
+        add_compile_timings(load.vertex_result);
+    });
+    auto const &vertex_result = load.vertex_result;
+
+    auto fragment_cache_key = job.cache_key;
+    fragment_cache_key.append("fragment");
+    auto fragment_result = compile_stage(ShaderStage::FRAGMENT, fragment_cache_key, {&load.common_file, &load.user_code, &job.code_file, &job.inputs_file}, job.defines);
+    add_compile_timings(fragment_result);
+    job.timings.spirv_instructions_unoptimized = fragment_result.unoptimized_instruction_count;
+    job.timings.spirv_instructions = count_spirv_instructions(fragment_result.spirv);
+    if (!vertex_result.error.empty() || !fragment_result.error.empty()) {
+        job.error = vertex_result.error + fragment_result.error;
+        return;
+    }
+    job.reads_frame_inputs = reads_frame_inputs(fragment_result.spirv);
+
+    auto const pipeline_t0 = Clock::now();
+    auto create_pipeline = [&](daxa::Format format) {
+        auto pipeline_key = fragment_cache_key;
+        pipeline_key.append(std::to_string(load.vertex_cache_key.hash));
+        pipeline_key.append(std::to_string(static_cast<uint32_t>(format)));
+        return std::make_shared<daxa::RasterPipeline>(pipeline_cache_stats.create_raster_pipeline(daxa_device, pipeline_key, {
+            .vertex_shader_info = daxa::ShaderInfo{
+                .byte_code = vertex_result.spirv.data(),
+                .byte_code_size = static_cast<uint32_t>(vertex_result.spirv.size()),
             },
-            .fragment_shader_info = daxa::ShaderCompileInfo{
-                .source = daxa::ShaderFile{shader_include_dir / "app/viewport.glsl"},
-                .compile_options{
-                    .root_paths = {shader_include_dir},
-                    .defines = extra_defines,
-                },
+            .fragment_shader_info = daxa::ShaderInfo{
+                .byte_code = fragment_result.spirv.data(),
+                .byte_code_size = static_cast<uint32_t>(fragment_result.spirv.size()),
             },
             .color_attachments = {{
-                .format = pass_format,
+                .format = format,
             }},
             .push_constant_size = sizeof(ShaderToyPush),
-            .name = pipeline_name,
-        });
-        if (compile_result.is_err() || !compile_result.value()->is_valid()) {
-            core::log_error(pipeline_name + ": " + compile_result.message());
+            .name = job.name,
+        }));
+    };
+    job.pipeline = create_pipeline(job.format);
+    // The image pass can also render straight into the swapchain, which needs a variant for its format.
+    if (job.type == "image" && load.swapchain_format != daxa::Format::UNDEFINED) {
+        job.swapchain_pipeline = create_pipeline(load.swapchain_format);
+    }
+    job.timings.pipeline_ms = std::chrono::duration<double, std::milli>(Clock::now() - pipeline_t0).count();
+}
+
+void Viewport::wait_for_load() {
+    if (!pending_load) {
+        return;
+    }
+    auto jobs_remaining = pending_load->jobs_remaining.load();
+    while (jobs_remaining != 0) {
+        pending_load->jobs_remaining.wait(jobs_remaining);
+        jobs_remaining = pending_load->jobs_remaining.load();
+    }
+    for (auto const *previous = pending_load->previous_load.get(); previous != nullptr; previous = previous->previous_load.get()) {
+        auto decodes_remaining = previous->texture_decodes_remaining.load();
+        while (decodes_remaining != 0) {
+            previous->texture_decodes_remaining.wait(decodes_remaining);
+            decodes_remaining = previous->texture_decodes_remaining.load();
+        }
+    }
+}
+
+auto Viewport::warm_up_pipelines(ShaderLoad const &load) -> double {
+    auto const t0 = Clock::now();
+
+    auto temp_task_graph = daxa::TaskGraph(daxa::TaskGraphInfo{
+        .device = daxa_device,
+        .name = "warm_up_tg",
+    });
+    auto targets = std::unordered_map<daxa::Format, daxa::TaskImageView>{};
+    auto any_new_pipelines = false;
+    for (auto const &job : load.compile_jobs) {
+        if (job.timings.reused || !job.pipeline) {
+            continue;
+        }
+        any_new_pipelines = true;
+        auto warm_up = [&](std::shared_ptr<daxa::RasterPipeline> const &pipeline, daxa::Format format) {
+            if (!targets.contains(format)) {
+                targets[format] = temp_task_graph.create_transient_image({
+                    .format = format,
+                    .size = {1, 1, 1},
+                    .name = "warm_up_target",
+                });
+            }
+            auto target = targets.at(format);
+            temp_task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskImageAccess::COLOR_ATTACHMENT, daxa::ImageViewType::REGULAR_2D, target),
+                },
+                .task = [pipeline, target](daxa::TaskInterface const &ti) {
+                    auto renderpass = std::move(ti.recorder).begin_renderpass({
+                        .color_attachments = {{.image_view = ti.get(target).ids[0].default_view(), .load_op = daxa::AttachmentLoadOp::DONT_CARE}},
+                        .render_area = {.x = 0, .y = 0, .width = 1, .height = 1},
+                    });
+                    renderpass.set_pipeline(*pipeline);
+                    // Binding and drawing is what makes lazy drivers finish compiling the pipeline. The
+                    // empty scissor means no user code actually runs on these dummy inputs.
+                    renderpass.set_scissor({.x = 0, .y = 0, .width = 0, .height = 0});
+                    renderpass.push_constant(ShaderToyPush{});
+                    renderpass.draw({.vertex_count = 3});
+                    ti.recorder = std::move(renderpass).end_renderpass();
+                },
+                .name = "warm_up " + job.name,
+            });
+        };
+        warm_up(job.pipeline, job.format);
+        if (job.swapchain_pipeline) {
+            warm_up(job.swapchain_pipeline, load.swapchain_format);
+        }
+    }
+    if (!any_new_pipelines) {
+        return 0.0;
+    }
+    temp_task_graph.submit({});
+    temp_task_graph.complete({});
+    temp_task_graph.execute({});
+
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+void Viewport::record_load_timings(ShaderLoad const &load, double warm_up_ms) {
+    last_load_timings.load_index += 1;
+    last_load_timings.failed = load_failed;
+    last_load_timings.warm_up_ms = warm_up_ms;
+    last_load_timings.texture_decode_ms = load.texture_decode_ms;
+    last_load_timings.texture_upload_ms = load.texture_upload_ms;
+    last_load_timings.total_ms = std::chrono::duration<double, std::milli>(Clock::now() - load.start_time).count();
+    last_load_timings.passes.clear();
+    for (auto const &job : load.compile_jobs) {
+        last_load_timings.passes.push_back(job.timings);
+    }
+
+    // One JSON object per pass and load, so the log can be filtered and aggregated line by line.
+    auto const log_path = cache_dir / "load-timings.jsonl";
+    auto ec = std::error_code{};
+    if (std::filesystem::file_size(log_path, ec) > MAX_LOAD_TIMINGS_LOG_SIZE && !ec) {
+        std::filesystem::rename(log_path, cache_dir / "load-timings.1.jsonl", ec);
+    }
+    auto file = std::ofstream{log_path, std::ios::app};
+    for (auto const &pass : last_load_timings.passes) {
+        auto line = nlohmann::json{
+            {"load", last_load_timings.load_index},
+            {"shader", load.shader_id},
+            {"pass", pass.name},
+            {"failed", last_load_timings.failed},
+            {"reused", pass.reused},
+            {"spirv_cached", pass.spirv_cached},
+            {"texture_ms", pass.texture_ms},
+            {"preprocess_ms", pass.preprocess_ms},
+            {"parse_ms", pass.parse_ms},
+            {"spirv_ms", pass.spirv_ms},
+            {"optimize_ms", pass.optimize_ms},
+            {"spirv_instructions_unoptimized", pass.spirv_instructions_unoptimized},
+            {"spirv_instructions", pass.spirv_instructions},
+            {"pipeline_ms", pass.pipeline_ms},
+            {"load_warm_up_ms", last_load_timings.warm_up_ms},
+            {"load_texture_decode_ms", last_load_timings.texture_decode_ms},
+            {"load_texture_upload_ms", last_load_timings.texture_upload_ms},
+            {"load_total_ms", last_load_timings.total_ms},
+        };
+        file << line.dump() << "\n";
+    }
+}
+
+auto Viewport::update_load() -> bool {
+    if (!pending_load || pending_load->jobs_remaining.load() != 0) {
+        return false;
+    }
+    for (auto const *previous = pending_load->previous_load.get(); previous != nullptr; previous = previous->previous_load.get()) {
+        if (previous->texture_decodes_remaining.load() != 0) {
+            return false;
+        }
+    }
+    auto load = std::move(pending_load);
+    pipeline_cache_stats.save();
+
+    // The textures go out even when the passes failed to compile, they stay in loaded_textures.
+    auto const texture_upload_t0 = Clock::now();
+    for (auto *uploading = load.get(); uploading != nullptr; uploading = uploading->previous_load.get()) {
+        flush_texture_uploads(*uploading);
+    }
+    load->previous_load = {};
+    load->texture_upload_ms = std::chrono::duration<double, std::milli>(Clock::now() - texture_upload_t0).count();
+
+    for (auto &job : load->compile_jobs) {
+        if (!job.pipeline) {
+            core::log_error(job.name + ": " + job.error);
             this->load_failed = true;
-            return;
         }
+    }
+    auto const warm_up_ms = this->load_failed ? 0.0 : warm_up_pipelines(*load);
+    record_load_timings(*load, warm_up_ms);
+    if (this->load_failed) {
+        // Keep the previous passes running.
+        return false;
+    }
 
-        if (pass_type == "image") {
-            new_image_pass = {name, temp_inputs, compile_result.value()};
-        } else if (pass_type == "buffer") {
-            new_buffer_passes.emplace_back(name, temp_inputs, compile_result.value());
-        } else if (pass_type == "cubemap") {
-            new_cube_passes.emplace_back(name, temp_inputs, compile_result.value());
+    std::vector<ShaderBufferPass> new_buffer_passes{};
+    std::vector<ShaderCubePass> new_cube_passes{};
+    ShaderBufferPass new_image_pass{};
+
+    // Passes that survive the edit keep their ping-pong images, so they don't get reallocated.
+    auto take_live_buffer = [](auto &live_passes, std::string const &name) -> PingPongImage {
+        for (auto &pass : live_passes) {
+            if (pass.name == name) {
+                return std::move(pass.buffer);
+            }
+        }
+        return {};
+    };
+
+    for (auto &job : load->compile_jobs) {
+        if (job.type == "image") {
+            new_image_pass = {job.name, std::move(job.inputs), std::move(job.pipeline)};
+            new_image_pass.source_hash = job.cache_key.hash;
+            new_image_pass.swapchain_pipeline = std::move(job.swapchain_pipeline);
+            new_image_pass.reads_frame_inputs = job.reads_frame_inputs;
+        } else if (job.type == "buffer") {
+            auto &pass = new_buffer_passes.emplace_back(job.name, std::move(job.inputs), std::move(job.pipeline), take_live_buffer(buffer_passes, job.name));
+            pass.source_hash = job.cache_key.hash;
+            pass.reads_frame_inputs = job.reads_frame_inputs;
+        } else if (job.type == "cubemap") {
+            auto &pass = new_cube_passes.emplace_back(job.name, std::move(job.inputs), std::move(job.pipeline), take_live_buffer(cube_passes, job.name));
+            pass.source_hash = job.cache_key.hash;
+            pass.size = job.cube_size;
+            pass.format = job.format;
+            pass.reads_frame_inputs = job.reads_frame_inputs;
+        }
+    }
+
+    {
+        // Buffer and cube passes that the image pass doesn't depend on, directly or through other passes,
+        // are never recorded.
+        for (auto &pass : new_buffer_passes) {
+            pass.reachable = false;
+        }
+        for (auto &pass : new_cube_passes) {
+            pass.reachable = false;
+        }
+        auto pending = std::vector<std::vector<ShaderPassInput> const *>{&new_image_pass.inputs};
+        while (!pending.empty()) {
+            auto const *inputs = pending.back();
+            pending.pop_back();
+            for (auto const &input : *inputs) {
+                auto visit = [&](auto &pass) {
+                    if (!pass.reachable) {
+                        pass.reachable = true;
+                        pending.push_back(&pass.inputs);
+                    }
+                };
+                if (input.type == ShaderPassInputType::BUFFER) {
+                    visit(new_buffer_passes[input.index]);
+                } else if (input.type == ShaderPassInputType::CUBE) {
+                    visit(new_cube_passes[input.index]);
+                }
+            }
         }
+        auto const mark_timings = [&](auto const &pass) {
+            for (auto &timings : last_load_timings.passes) {
+                if (timings.name == pass.name) {
+                    timings.reachable = pass.reachable;
+                }
+            }
+        };
+        std::ranges::for_each(new_buffer_passes, mark_timings);
+        std::ranges::for_each(new_cube_passes, mark_timings);
     }
 
     {
         auto mip_sampler0 = samplers[static_cast<size_t>(ShaderToyFilter::MIPMAP) + static_cast<size_t>(ShaderToyWrap::CLAMP) * 3];
         auto mip_sampler1 = samplers[static_cast<size_t>(ShaderToyFilter::MIPMAP) + static_cast<size_t>(ShaderToyWrap::REPEAT) * 3];
         auto pass_needs_mipmaps = [&](auto &pass) {
+            if (!pass.reachable) {
+                return;
+            }
             for (auto &input : pass.inputs) {
                 if (input.type == ShaderPassInputType::NONE) {
                     continue;
@@ -1244,20 +2395,35 @@ void Viewport::load_shadertoy_json(nlohmann::json json) {
         pass_needs_mipmaps(new_image_pass);
     }
 
-    for (auto &pass : buffer_passes)
-        if (pass.pipeline)
-            pipeline_manager.remove_raster_pipeline(pass.pipeline);
-    for (auto &pass : new_cube_passes)
-        if (pass.pipeline)
-            pipeline_manager.remove_raster_pipeline(pass.pipeline);
-    if (image_pass.pipeline)
-        pipeline_manager.remove_raster_pipeline(image_pass.pipeline);
+    {
+        // Buffer passes are recorded before cube passes. A pass that only reads passes recorded before it
+        // never sees a history image, so if it doesn't read any frame inputs either, its output only
+        // changes when one of its inputs does.
+        auto const order_of = [&](ShaderPassInput const &input) {
+            return input.type == ShaderPassInputType::CUBE ? new_buffer_passes.size() + input.index : input.index;
+        };
+        auto const update_frame_invariant = [&](auto &pass, size_t order) {
+            pass.frame_invariant = !pass.reads_frame_inputs && std::ranges::all_of(pass.inputs, [&](ShaderPassInput const &input) {
+                return (input.type != ShaderPassInputType::BUFFER && input.type != ShaderPassInputType::CUBE) || order_of(input) < order;
+            });
+            for (auto &timings : last_load_timings.passes) {
+                if (timings.name == pass.name) {
+                    timings.frame_invariant = pass.frame_invariant;
+                }
+            }
+        };
+        for (size_t i = 0; i < new_buffer_passes.size(); ++i) {
+            update_frame_invariant(new_buffer_passes[i], i);
+        }
+        for (size_t i = 0; i < new_cube_passes.size(); ++i) {
+            update_frame_invariant(new_cube_passes[i], new_buffer_passes.size() + i);
+        }
+    }
 
     buffer_passes = std::move(new_buffer_passes);
     cube_passes = std::move(new_cube_passes);
     image_pass = std::move(new_image_pass);
 
-    first_record_after_load = true;
-
     reset();
+    return true;
 }
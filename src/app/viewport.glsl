@@ -131,14 +131,14 @@ void main() {
     iSampleRate           = deref(daxa_push_constant.gpu_input).SampleRate;
     // clang-format on
 #if CUBEMAP
-    iResolution = vec3(1024, 1024, 1);
+    iResolution = vec3(CUBEMAP_SIZE, CUBEMAP_SIZE, 1);
 #endif
 
     vec4 frag_color = vec4(0);
 
 #if CUBEMAP
     vec2 fragCoord = vec2(gl_FragCoord.xy);
-    vec2 uv = fragCoord / 1024.0 * 2.0 - 1.0;
+    vec2 uv = fragCoord / float(CUBEMAP_SIZE) * 2.0 - 1.0;
 
     vec3 ray_dir;
     switch (daxa_push_constant.face_index) {
@@ -154,7 +154,7 @@ void main() {
     mainCubemap(frag_color, fragCoord, vec3(0, 0, 0), ray_dir);
 #else
     vec2 frame_dim = iResolution.xy;
-    vec2 fragCoord = vec2(gl_FragCoord.xy);
+    vec2 fragCoord = vec2(gl_FragCoord.x, gl_FragCoord.y * daxa_push_constant.frag_coord_y_scale) + daxa_push_constant.frag_coord_offset;
     mainImage(frag_color, fragCoord);
 
     if (_daxa_st_assert_index != -1) {
@@ -2,6 +2,13 @@
 
 #include <app/viewport.inl>
 #include <app/ping_pong_resource.hpp>
+#include <app/spirv_cache.hpp>
+#include <app/pipeline_cache_stats.hpp>
+#include <app/load_timings.hpp>
+#include <app/dynamic_resolution.hpp>
+#include <app/gpu_profiler.hpp>
+#include <app/shader_compiler.hpp>
+#include <thread_pool.hpp>
 
 #include <daxa/daxa.hpp>
 #include <daxa/utils/pipeline_manager.hpp>
@@ -24,6 +31,13 @@ struct KeyboardInput {
     std::array<int8_t, 256> toggles{};
 };
 
+// One slot of the upload ring. The shaders read GpuInput straight from it, and the keyboard
+// state is copied into the keyboard image from it.
+struct UploadRingSlot {
+    GpuInput gpu_input;
+    KeyboardInput keyboard_input;
+};
+
 struct ShaderPassInput {
     ShaderPassInputType type{};
     size_t index{};
@@ -38,6 +52,21 @@ struct ShaderBufferPass {
     PingPongImage buffer;
     daxa::TaskImageView recording_buffer_view;
     bool needs_mipmap{};
+    // Of the allocated images, set by Viewport::record().
+    uint32_t mip_level_count = 1;
+    uint64_t source_hash{};
+    // Whether the image pass depends on this pass. Unreachable passes aren't recorded and hold no images.
+    bool reachable = true;
+    // Whether the fragment shader reads a GpuInput field that changes every frame, like iTime.
+    bool reads_frame_inputs = true;
+    // Frame invariant passes skip rendering while their inputs don't change, see Viewport::render().
+    bool frame_invariant{};
+    uint32_t pending_renders{};
+    bool renders_this_frame = true;
+    // Image pass only: the same shader, built for the swapchain's color format.
+    std::shared_ptr<daxa::RasterPipeline> swapchain_pipeline;
+    // The images from before the last resize, kept until their contents were copied over.
+    PingPongImage resize_source;
 };
 
 struct ShaderCubePass {
@@ -47,16 +76,71 @@ struct ShaderCubePass {
     PingPongImage buffer;
     daxa::TaskImageView recording_buffer_view;
     bool needs_mipmap{};
+    uint32_t mip_level_count = 1;
+    uint64_t source_hash{};
+    bool reachable = true;
+    bool reads_frame_inputs = true;
+    bool frame_invariant{};
+    uint32_t pending_renders{};
+    bool renders_this_frame = true;
+    // Face size and format, from the pass' optional "cube_size" and "cube_format" fields.
+    uint32_t size = 1024;
+    daxa::Format format = daxa::Format::R16G16B16A16_SFLOAT;
+};
+
+struct ShaderLoad;
+struct ShaderPassCompileJob;
+
+enum struct TextureSourceKind {
+    TEXTURE,
+    // Not flipped, unlike 2D textures.
+    CUBE_FACE,
+    // Generated from the input's id instead of read from a file.
+    VOLUME,
+};
+
+// A texture's pixels, staged for upload. They're decoded on the thread pool straight into the
+// load's staging arena.
+struct DecodedImage {
+    size_t staging_offset{};
+    daxa_u32vec3 size{};
+    // UNDEFINED when the file couldn't be read.
+    daxa::Format format = daxa::Format::UNDEFINED;
+    uint32_t pixel_size_bytes = 4;
+    // False when the file's header was read, but its pixels couldn't be. Set by the decode job.
+    bool decoded = false;
+};
+
+// A copy into one layer of a newly created texture, submitted by flush_texture_uploads().
+struct TextureUpload {
+    daxa::ImageId image;
+    uint32_t array_layer{};
+    std::string path;
+    TextureSourceKind kind{};
+    DecodedImage source;
+};
+
+// Where the image pass may render to directly, instead of an intermediate image.
+struct ViewportTarget {
+    daxa::TaskImageView image;
+    daxa::Format format{};
+    // Top left corner of the viewport in `image`, queried when the frame is recorded.
+    std::function<daxa_i32vec2()> get_offset;
 };
 
 struct Viewport {
     daxa::Device daxa_device;
-    daxa::PipelineManager pipeline_manager;
+    ThreadPool thread_pool{};
+    SpirvCache spirv_cache;
+    PipelineCacheStats pipeline_cache_stats;
 
     std::vector<ShaderBufferPass> buffer_passes{};
     std::vector<ShaderCubePass> cube_passes{};
     ShaderBufferPass image_pass{};
     std::array<daxa::SamplerId, 6> samplers{};
+    // Builds mip chains for passes that are sampled with a mipmap filter. Null if it failed to
+    // compile, then the chains are blitted level by level instead.
+    std::shared_ptr<daxa::ComputePipeline> mipmap_pipeline;
     std::unordered_map<std::string, std::pair<daxa::ImageId, size_t>> loaded_textures{};
     std::vector<daxa::TaskImage> task_textures{};
     GpuInput gpu_input{};
@@ -74,8 +158,43 @@ struct Viewport {
     KeyboardInput keyboard_input{};
     daxa_f32vec2 mouse_pos{};
 
-    bool first_record_after_load{};
+    // Persistently mapped, with one slot per frame in flight.
+    uint32_t frames_in_flight = 1;
+    daxa::BufferId upload_ring{};
+    std::byte *upload_ring_ptr{};
+    uint32_t upload_ring_slot{};
+    daxa::ImageId keyboard_image{};
+    daxa::TaskImage task_keyboard_image{};
+    // Set by on_key. The keyboard image is only re-uploaded on frames where this was set.
+    bool keyboard_dirty = true;
+    bool keyboard_upload_pending{};
+    // Executed by render() only on those frames, so the main graphs never write the keyboard image.
+    daxa::TaskGraph keyboard_upload_task_graph{};
+
+    // Set when record() resized buffer passes, until the main graph copied their contents over.
+    bool resize_copy_pending{};
+    bool resize_copy_done{};
+    // Resample instead of crop when copying, for render scale changes.
+    bool resize_copy_stretch{};
+
+    BufferMemoryStats buffer_memory{};
+
+    // The viewport's size on screen. gpu_input.Resolution is this times the render scale.
+    daxa_f32vec2 display_size{};
+    DynamicResolution dynamic_resolution{};
+    // Two timestamps per frame in flight, around all of the viewport's passes.
+    daxa::TimelineQueryPool timestamp_pool{};
+    std::vector<bool> timestamps_written{};
+    double last_gpu_ms{};
+    // Per task timings, for the GPU timings window and headless runs.
+    GpuProfiler gpu_profiler{};
+
     bool load_failed{};
+    std::shared_ptr<ShaderLoad> pending_load{};
+    ShaderLoadTimings last_load_timings{};
+    SpirvOptimization spirv_optimization = SpirvOptimization::NONE;
+    // The image pass gets a pipeline variant for this format, see record().
+    daxa::Format swapchain_format = daxa::Format::UNDEFINED;
 
     explicit Viewport(daxa::Device a_daxa_device);
     ~Viewport();
@@ -87,16 +206,50 @@ struct Viewport {
 
     void update();
     void render();
-    auto record(daxa::TaskGraph &task_graph) -> daxa::TaskImageView;
+    // Renders the image pass straight into `direct_target` when its pipeline allows it, and then
+    // returns nothing. Otherwise returns the intermediate image the caller has to blit from.
+    auto record(daxa::TaskGraph &task_graph, std::optional<ViewportTarget> const &direct_target = std::nullopt) -> std::optional<daxa::TaskImageView>;
+    auto can_render_direct(daxa::Format format) const -> bool;
+    // Sets the size on screen. The passes render at this times the dynamic resolution scale.
+    void set_viewport_size(daxa_f32vec2 size);
+    // Feeds the last finished frame's GPU time to the controller. When this returns true, the
+    // render scale changed and the task graphs have to be recorded again.
+    auto update_render_scale() -> bool;
+    // True once after the resize copy was recorded. The graphs then have to be recorded again, to
+    // drop the copy's attachments and free the pre-resize images.
+    auto take_resize_copy_done() -> bool;
+    // Reads the per task timings of the last finished frame into gpu_profiler, without waiting.
+    void read_gpu_timings();
     void reset();
+    // Resizes the upload ring and timestamp pools. The device must be idle.
+    void set_frames_in_flight(uint32_t count);
 
     void on_mouse_move(float px, float py);
     void on_mouse_button(int32_t button_id, int32_t action);
     void on_key(int32_t key_id, int32_t action);
     void on_toggle_pause(bool is_paused);
 
-    auto load_texture(std::string path) -> std::pair<daxa::ImageId, size_t>;
-    auto load_cube_texture(std::string path) -> std::pair<daxa::ImageId, size_t>;
-    auto load_volume_texture(std::string id) -> std::pair<daxa::ImageId, size_t>;
+    // Starts compiling the project in the background. The currently loaded passes keep
+    // rendering until update_load() swaps the new ones in.
     void load_shadertoy_json(nlohmann::json json);
+    auto update_load() -> bool;
+    void wait_for_load();
+
+  private:
+    void create_frame_resources();
+    auto upload_slot_offset() const -> size_t;
+    void create_mipmap_pipeline();
+    void record_mipmaps(daxa::TaskGraph &task_graph, daxa::TaskImageView const &image, uint32_t layer_count, uint32_t mip_level_count, std::string const &name, bool const *renders_this_frame);
+    // Create the images from the files' headers and queue their uploads in `load`.
+    auto load_texture(ShaderLoad &load, std::string path) -> std::pair<daxa::ImageId, size_t>;
+    auto load_cube_texture(ShaderLoad &load, std::string path) -> std::pair<daxa::ImageId, size_t>;
+    auto load_volume_texture(ShaderLoad &load, std::string id) -> std::pair<daxa::ImageId, size_t>;
+    // Allocates the load's staging arena and queues a decode job per upload on the thread pool.
+    // The jobs count towards the load's jobs_remaining, nothing waits for them here.
+    void stage_textures(std::shared_ptr<ShaderLoad> const &load);
+    // Records the load's texture copies into one task graph and submits it, then frees the staging memory.
+    void flush_texture_uploads(ShaderLoad &load);
+    void compile_pass(ShaderLoad &load, ShaderPassCompileJob &job);
+    auto warm_up_pipelines(ShaderLoad const &load) -> double;
+    void record_load_timings(ShaderLoad const &load, double warm_up_ms);
 };
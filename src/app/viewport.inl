@@ -46,6 +46,9 @@ struct ShaderToyPush {
     daxa_BufferPtr(GpuInput) gpu_input;
     InputImages input_images;
     daxa_u32 face_index;
+    // fragCoord = gl_FragCoord.xy * vec2(1, frag_coord_y_scale) + frag_coord_offset
+    daxa_f32vec2 frag_coord_offset;
+    daxa_f32 frag_coord_y_scale;
 };
 
 #if DAXA_SHADER
@@ -26,6 +26,9 @@
 
 #include <iostream>
 #include <format>
+#include <sstream>
+#include <cmath>
+#include <numeric>
 using Clock = std::chrono::high_resolution_clock;
 
 struct Timer {
@@ -42,10 +45,29 @@ struct ShaderApp {
     daxa::Instance daxa_instance;
     daxa::Device daxa_device;
     AppUi ui;
-    daxa::TaskGraph main_task_graph;
+    // One per frame in flight, so that frames recorded ahead don't share transient memory.
+    std::vector<daxa::TaskGraph> main_task_graphs;
     daxa::TaskImage task_swapchain_image;
+    uint64_t frame_index{};
+
+    // A drag-resize doesn't reallocate the buffer passes on every pixel. The viewport keeps its
+    // resolution and is stretched until the size didn't change for RESIZE_DEBOUNCE.
+    static constexpr auto RESIZE_DEBOUNCE = std::chrono::milliseconds{150};
+    Clock::time_point resize_settle_time{};
+    bool resize_pending = false;
 
     Viewport viewport;
+    bool main_task_graph_recorded = false;
+    // Block on shader loads instead of swapping them in whenever they finish.
+    bool wait_for_loads = false;
+
+    // While paused, frames are only rendered when the UI, the input or the viewport size changed.
+    // While unfocused or hidden, they're rendered at settings.background_frame_rate, and while
+    // minimized the loop blocks on events. Benchmarks turn this off.
+    bool throttle_when_idle = true;
+    bool render_this_frame = true;
+    uint64_t rendered_event_count{};
+    Clock::time_point next_background_frame_time{};
 
     ShaderApp();
     ~ShaderApp();
@@ -56,10 +78,12 @@ struct ShaderApp {
     auto operator=(ShaderApp &&) -> ShaderApp & = delete;
 
     void update();
+    auto wait_for_frame() -> bool;
     auto should_close() -> bool;
     void render();
     void download_shadertoy(std::string const &input);
     auto record_main_task_graph() -> daxa::TaskGraph;
+    void record_main_task_graphs();
 };
 
 std::ofstream *f_ptr = nullptr;
@@ -220,6 +244,8 @@ void test_all_shadertoys() {
     f_ptr = &f;
 
     auto app = ShaderApp();
+    app.wait_for_loads = true;
+    app.throttle_when_idle = false;
     while (true) {
         auto t0 = Clock::now();
         std::filesystem::path path;
@@ -246,7 +272,13 @@ void test_all_shadertoys() {
         auto json = nlohmann::json::parse(std::ifstream(path));
         app.ui.buffer_panel.load_shadertoy_json(json);
 
-        std::cout << std::format("{}, // {}\n", shaders_tested, path.string()) << std::flush;
+        auto const &pipeline_stats = app.viewport.pipeline_cache_stats;
+        std::cout << std::format(
+                         "{}, // {} (spirv cache: {} hits, {} misses, pipelines: {} warm, {} cold, {:.1f}ms saved)\n",
+                         shaders_tested, path.string(),
+                         app.viewport.spirv_cache.hits.load(), app.viewport.spirv_cache.misses.load(),
+                         pipeline_stats.warm_creations.load(), pipeline_stats.cold_creations.load(), static_cast<double>(pipeline_stats.saved_time_ns.load()) * 1e-6)
+                  << std::flush;
         app.update();
         if (app.should_close()) {
             break;
@@ -278,6 +310,208 @@ void test_all_shadertoys() {
     }
 }
 
+void replace_all(std::string &s, std::string const &toReplace, std::string const &replaceWith, bool wordBoundary = false);
+void shader_preprocess(std::string &contents, std::filesystem::path const &path);
+void unescape_shader_code(std::string &code);
+
+// The line-based implementation shader_preprocess replaced, kept as the benchmark baseline.
+void legacy_shader_preprocess(std::string &contents) {
+    std::string line = {};
+    std::stringstream file_ss{contents};
+    std::stringstream result_ss = {};
+    while (std::getline(file_ss, line)) {
+        replace_all(line, "sampler2D", "CombinedImageSampler2D", true);
+        replace_all(line, "sampler3D", "CombinedImageSampler3D", true);
+        replace_all(line, "samplerCube", "CombinedImageSamplerCube", true);
+        replace_all(line, "textureCube", "ds_TextureCube", true);
+        replace_all(line, "packUnorm2x16", "ds_PackUnorm2x16", true);
+        replace_all(line, "packSnorm2x16", "ds_PackSnorm2x16", true);
+        replace_all(line, "packUnorm4x8", "ds_PackUnorm4x8", true);
+        replace_all(line, "packSnorm4x8", "ds_PackSnorm4x8", true);
+        replace_all(line, "unpackUnorm2x16", "ds_UnpackUnorm2x16", true);
+        replace_all(line, "unpackSnorm2x16", "ds_UnpackSnorm2x16", true);
+        replace_all(line, "unpackUnorm4x8", "ds_UnpackUnorm4x8", true);
+        replace_all(line, "unpackSnorm4x8", "ds_UnpackSnorm4x8", true);
+        replace_all(line, "buffer", "ds_Buffer", true);
+        replace_all(line, "sampler", "ds_Sampler", true);
+        result_ss << line << "\n";
+    }
+    contents = result_ss.str();
+}
+
+void benchmark_shader_preprocess() {
+    auto sources = std::vector<std::pair<std::filesystem::path, std::string>>{};
+    for (auto const &dir_entry : std::filesystem::directory_iterator{"shaders"}) {
+        auto json = nlohmann::json::parse(std::ifstream(dir_entry.path()), nullptr, false);
+        if (json.is_discarded() || !json.contains("renderpass")) {
+            continue;
+        }
+        auto code = std::string{};
+        for (auto &renderpass : json["renderpass"]) {
+            auto pass_code = std::string{renderpass["code"]};
+            unescape_shader_code(pass_code);
+            code += pass_code;
+        }
+        sources.emplace_back(dir_entry.path(), std::move(code));
+    }
+    // Escaped newlines in comments of normal code have to survive loading.
+    {
+        auto code = std::string{"// split on \\n here\nvoid mainImage(out vec4 fragColor, in vec2 fragCoord) { fragColor = vec4(0.0); }\n"};
+        auto const expected = code;
+        unescape_shader_code(code);
+        if (code != expected) {
+            std::cout << "escaped newline in a comment was rewritten\n";
+        }
+        sources.emplace_back("comment_escaped_newline", std::move(code));
+    }
+    std::sort(sources.begin(), sources.end(), [](auto const &a, auto const &b) { return a.second.size() < b.second.size(); });
+
+    constexpr auto ITERATIONS = 16;
+    auto f = std::ofstream("preprocess-times.txt");
+    auto total_bytes = size_t{};
+    auto total_legacy = 0.0;
+    auto total_new = 0.0;
+    auto mismatches = 0;
+    for (auto const &[path, code] : sources) {
+        auto time = [&](auto &&preprocess) {
+            auto t0 = Clock::now();
+            for (int i = 0; i < ITERATIONS; ++i) {
+                auto contents = code;
+                preprocess(contents);
+            }
+            return std::chrono::duration<double>(Clock::now() - t0).count() / ITERATIONS;
+        };
+        auto legacy_time = time([](std::string &contents) { legacy_shader_preprocess(contents); });
+        auto new_time = time([](std::string &contents) { shader_preprocess(contents, "user_code"); });
+
+        // The old word boundary check didn't count 'z', 'Z' and '9' as identifier characters,
+        // so a few names like "zbuffer" were rewritten by it and aren't anymore.
+        auto legacy_result = code;
+        auto new_result = code;
+        legacy_shader_preprocess(legacy_result);
+        shader_preprocess(new_result, "user_code");
+        if (legacy_result != new_result) {
+            ++mismatches;
+        }
+
+        total_bytes += code.size();
+        total_legacy += legacy_time;
+        total_new += new_time;
+        f << std::format("{}, {}, {}, {}\n", path.string(), code.size(), legacy_time, new_time);
+    }
+
+    auto mib = static_cast<double>(total_bytes) / (1024.0 * 1024.0);
+    std::cout << std::format("{} shaders, {:.2f} MiB of code\n", sources.size(), mib);
+    std::cout << std::format("legacy: {:.3f}s ({:.1f} MiB/s)\n", total_legacy, mib / total_legacy);
+    std::cout << std::format("new:    {:.3f}s ({:.1f} MiB/s, {:.1f}x)\n", total_new, mib / total_new, total_legacy / total_new);
+    std::cout << std::format("{} shaders preprocess differently\n", mismatches) << std::flush;
+}
+
+// Drag-resizes the window while a shader with four self-feedback buffers runs, and reports frame times.
+void benchmark_resize() {
+    auto buffer_ids = std::array{"4dXGR8", "XsXGR8", "4sXGR8", "XdfGR8"};
+    auto buffer_names = std::array{"Buffer A", "Buffer B", "Buffer C", "Buffer D"};
+    auto json = nlohmann::json{
+        {"info", {{"id", "resize-benchmark"}}},
+        {"renderpass", nlohmann::json::array()},
+    };
+    auto sampler = nlohmann::json{{"filter", "linear"}, {"wrap", "clamp"}};
+    auto image_inputs = nlohmann::json::array();
+    for (uint32_t i = 0; i < buffer_ids.size(); ++i) {
+        json["renderpass"].push_back({
+            {"name", buffer_names[i]},
+            {"type", "buffer"},
+            {"inputs", {{{"id", buffer_ids[i]}, {"type", "buffer"}, {"channel", 0}, {"sampler", sampler}}}},
+            {"outputs", {{{"id", buffer_ids[i]}, {"channel", 0}}}},
+            {"code", std::format(
+                         "void mainImage(out vec4 fragColor, in vec2 fragCoord) {{\n"
+                         "    vec2 uv = fragCoord / iResolution.xy;\n"
+                         "    vec4 history = texelFetch(iChannel0, ivec2(fragCoord), 0);\n"
+                         "    fragColor = mix(history, vec4(0.5 + 0.5 * cos(iTime + uv.xyx + vec3({}, 2, 4)), 1), 0.05);\n"
+                         "}}\n",
+                         i)},
+        });
+        image_inputs.push_back({{"id", buffer_ids[i]}, {"type", "buffer"}, {"channel", i}, {"sampler", sampler}});
+    }
+    json["renderpass"].push_back({
+        {"name", "Image"},
+        {"type", "image"},
+        {"inputs", image_inputs},
+        {"outputs", {{{"id", "4dfGRr"}, {"channel", 0}}}},
+        {"code",
+         "void mainImage(out vec4 fragColor, in vec2 fragCoord) {\n"
+         "    vec2 uv = fragCoord / iResolution.xy;\n"
+         "    fragColor = (texture(iChannel0, uv) + texture(iChannel1, uv) + texture(iChannel2, uv) + texture(iChannel3, uv)) * 0.25;\n"
+         "}\n"},
+    });
+
+    auto app = ShaderApp();
+    app.wait_for_loads = true;
+    app.throttle_when_idle = false;
+    app.ui.app_window.set_vsync(false);
+    app.ui.buffer_panel.load_shadertoy_json(json);
+    for (int i = 0; i < 16; ++i) {
+        app.update();
+        app.render();
+    }
+
+    constexpr auto FRAMES = 600;
+    auto *window = app.ui.app_window.glfw_window.get();
+    auto base_size = app.ui.app_window.size;
+    auto frame_times = std::vector<double>{};
+    frame_times.reserve(FRAMES);
+    for (int i = 0; i < FRAMES; ++i) {
+        // Grow and shrink by a few pixels every frame, like a drag does.
+        auto const delta = static_cast<int>(std::sin(static_cast<double>(i) * 0.05) * 200.0);
+        glfwSetWindowSize(window, base_size.x + delta, base_size.y + delta / 2);
+        auto t0 = Clock::now();
+        app.update();
+        if (app.should_close()) {
+            break;
+        }
+        app.render();
+        frame_times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+    }
+    app.daxa_device.wait_idle();
+    if (frame_times.empty()) {
+        return;
+    }
+
+    auto sorted = frame_times;
+    std::sort(sorted.begin(), sorted.end());
+    auto const median = sorted[sorted.size() / 2];
+    auto const p99 = sorted[sorted.size() * 99 / 100];
+    auto const stutters = std::count_if(frame_times.begin(), frame_times.end(), [&](double t) { return t > median * 3.0; });
+    auto const total = std::accumulate(frame_times.begin(), frame_times.end(), 0.0);
+    std::cout << std::format("{} resize frames: avg {:.2f}ms, median {:.2f}ms, p99 {:.2f}ms, max {:.2f}ms, {} frames over 3x median\n",
+                             frame_times.size(), total / static_cast<double>(frame_times.size()), median, p99, sorted.back(), stutters)
+              << std::flush;
+}
+
+void benchmark_gpu_timings(std::filesystem::path const &path) {
+    auto app = ShaderApp();
+    app.wait_for_loads = true;
+    app.throttle_when_idle = false;
+    app.ui.app_window.set_vsync(false);
+    app.ui.buffer_panel.load_shadertoy_json(nlohmann::json::parse(std::ifstream(path)));
+    // More than the profiler's history, so that all of it is from after the load.
+    for (size_t i = 0; i < GpuProfiler::HISTORY_SIZE + 16; ++i) {
+        app.update();
+        if (app.should_close()) {
+            break;
+        }
+        app.render();
+    }
+    app.daxa_device.wait_idle();
+
+    auto const timings = app.viewport.gpu_profiler.timings();
+    std::cout << std::format("{}: {:.3f}ms avg GPU frame time over {} frames\n", path.string(), timings.avg_frame_ms, timings.frame_history_ms.size());
+    for (auto const &scope : timings.scopes) {
+        std::cout << std::format("    {:<32} avg {:.3f}ms, max {:.3f}ms\n", scope.name, scope.avg_ms, scope.max_ms);
+    }
+    std::cout << std::flush;
+}
+
 auto main() -> int {
     search_for_path_to_fix_working_directory(std::array{
         std::filesystem::path{"media"},
@@ -289,6 +523,15 @@ auto main() -> int {
     // test_all_shadertoys();
     // return 0;
 
+    // benchmark_shader_preprocess();
+    // return 0;
+
+    // benchmark_resize();
+    // return 0;
+
+    // benchmark_gpu_timings(resource_dir / "default-shader.json");
+    // return 0;
+
     auto app = ShaderApp();
     while (true) {
         app.update();
@@ -312,13 +555,27 @@ ShaderApp::ShaderApp()
       ui{daxa_device},
       viewport{daxa_device},
       task_swapchain_image{daxa::TaskImageInfo{.swapchain_image = true}} {
+    viewport.swapchain_format = ui.app_window.swapchain.get_format();
     ui.app_window.on_resize = [&]() {
         if (ui.app_window.size.x <= 0 || ui.app_window.size.y <= 0) {
             return;
         }
         ui.rml_context->Update();
-        main_task_graph = record_main_task_graph();
+        // Only the first event of a resize records the graphs again, to switch them to stretching
+        // the viewport. The blit and the UI read the new rect and swapchain size when they run.
+        auto const was_resize_pending = resize_pending;
+        resize_pending = main_task_graph_recorded;
+        resize_settle_time = Clock::now() + RESIZE_DEBOUNCE;
+        if (resize_pending && !was_resize_pending) {
+            record_main_task_graphs();
+        }
+        // On Windows the main loop is blocked in the modal resize loop while the window is dragged,
+        // so the new size is only shown if it's rendered from here. Elsewhere the main loop keeps
+        // rendering while resize_pending is set, and renders the settled size once it's cleared.
+#if defined(_WIN32)
+        render_this_frame = true;
         render();
+#endif
     };
     ui.app_window.on_drop = [&](std::span<char const *> paths) {
         ui.buffer_panel.load_shadertoy_json(nlohmann::json::parse(std::ifstream(paths[0])));
@@ -335,13 +592,35 @@ ShaderApp::ShaderApp()
 
     ui.on_toggle_fullscreen = [&](bool is_fullscreen) {
         ui.app_window.set_fullscreen(is_fullscreen);
-        main_task_graph = record_main_task_graph();
+        record_main_task_graphs();
     };
 
     ui.on_download = [&](Rml::String const &rml_input) {
         download_shadertoy(rml_input);
     };
 
+    ui.on_spirv_optimization_change = [&](SpirvOptimization optimization) {
+        viewport.spirv_optimization = optimization;
+        // The preset is part of every pass' cache key, so this recompiles (or re-fetches) all of them.
+        ui.buffer_panel.dirty = true;
+    };
+
+    ui.on_dynamic_resolution_change = [&](bool enabled, double target_ms) {
+        viewport.dynamic_resolution.enabled = enabled;
+        viewport.dynamic_resolution.target_ms = target_ms;
+    };
+
+    ui.on_frames_in_flight_change = [&](uint32_t count) {
+        // The graphs reference the swapchain, which has to be destroyed before it can be recreated.
+        main_task_graphs.clear();
+        ui.app_window.set_frames_in_flight(count);
+        viewport.set_frames_in_flight(count);
+        viewport.swapchain_format = ui.app_window.swapchain.get_format();
+        if (main_task_graph_recorded) {
+            record_main_task_graphs();
+        }
+    };
+
     ui.buffer_panel.load_shadertoy_json(nlohmann::json::parse(std::ifstream(resource_dir / "default-shader.json")));
 }
 
@@ -353,13 +632,54 @@ ShaderApp::~ShaderApp() {
 }
 
 void ShaderApp::update() {
-    if (!ui.paused) {
+    render_this_frame = wait_for_frame();
+    if (render_this_frame) {
+        rendered_event_count = ui.app_window.event_count;
+    }
+    if (render_this_frame && !ui.paused) {
         viewport.update();
     }
-    ui.update(viewport.gpu_input.Time, viewport.last_known_fps);
+    ui.render_scale = viewport.dynamic_resolution.scale();
+    ui.update(viewport.gpu_input.Time, viewport.last_known_fps, viewport.last_load_timings, viewport.buffer_memory, viewport.gpu_profiler);
+}
+
+auto ShaderApp::wait_for_frame() -> bool {
+    if (!throttle_when_idle) {
+        return true;
+    }
+    auto &app_window = ui.app_window;
+    if (app_window.minimized) {
+        app_window.wait_events();
+        return false;
+    }
+    // Loads and resizes finish in the background, and need frames to be swapped in.
+    auto const changed = [&]() {
+        return app_window.event_count != rendered_event_count || ui.buffer_panel.dirty || viewport.pending_load != nullptr || resize_pending;
+    };
+    if (ui.paused) {
+        if (!changed()) {
+            app_window.wait_events();
+        }
+        return changed();
+    }
+    auto const frame_rate = ui.settings.background_frame_rate;
+    if (frame_rate != 0 && (!app_window.focused || !app_window.is_visible())) {
+        if (Clock::now() < next_background_frame_time) {
+            app_window.wait_events(next_background_frame_time - Clock::now());
+            if (Clock::now() < next_background_frame_time) {
+                return false;
+            }
+        }
+        auto const interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / static_cast<double>(frame_rate)));
+        next_background_frame_time = Clock::now() + interval;
+    }
+    return true;
 }
 
 void ShaderApp::render() {
+    if (!render_this_frame) {
+        return;
+    }
     auto &app_window = ui.app_window;
     if (app_window.size.x <= 0 || app_window.size.y <= 0) {
         return;
@@ -372,15 +692,41 @@ void ShaderApp::render() {
 
     if (ui.buffer_panel.dirty) {
         viewport.load_shadertoy_json(ui.buffer_panel.get_shadertoy_json());
-        main_task_graph = record_main_task_graph();
         ui.buffer_panel.dirty = false;
     }
 
+    // Shaders compile in the background while the previous ones keep running. There's nothing
+    // to keep running before the first load though.
+    if (wait_for_loads || !main_task_graph_recorded) {
+        viewport.wait_for_load();
+    }
+    // Before anything records the graphs again, which would drop this frame's scopes.
+    viewport.read_gpu_timings();
+    if (viewport.update_load() || !main_task_graph_recorded) {
+        record_main_task_graphs();
+        main_task_graph_recorded = true;
+    }
+    if (viewport.update_render_scale() && main_task_graph_recorded) {
+        record_main_task_graphs();
+    }
+    if (resize_pending && Clock::now() >= resize_settle_time) {
+        resize_pending = false;
+        record_main_task_graphs();
+    }
+    if (viewport.take_resize_copy_done()) {
+        record_main_task_graphs();
+    }
+
     viewport.render();
 
-    main_task_graph.execute({});
-    daxa_device.collect_garbage();
+    main_task_graphs[frame_index % main_task_graphs.size()].execute({});
+    // Resources retired this frame can't be freed before the GPU caught up with it anyway,
+    // which is frames_in_flight frames from now.
+    if (frame_index % ui.app_window.frames_in_flight == 0) {
+        daxa_device.collect_garbage();
+    }
 
+    ++frame_index;
     ++viewport.gpu_input.Frame;
 }
 
@@ -410,24 +756,29 @@ void ShaderApp::download_shadertoy(std::string const &input) {
     ui.buffer_panel.load_shadertoy_json(json["Shader"]);
 }
 
-auto ShaderApp::record_main_task_graph() -> daxa::TaskGraph {
-    auto viewport_size = daxa_f32vec2(ui.viewport_element->GetClientWidth(), ui.viewport_element->GetClientHeight());
-    if (ui.is_fullscreen) {
-        viewport_size = daxa_f32vec2{
-            static_cast<daxa_f32>(ui.app_window.size.x),
-            static_cast<daxa_f32>(ui.app_window.size.y),
-        };
+void ShaderApp::record_main_task_graphs() {
+    main_task_graphs.clear();
+    // Every graph registers the same scopes again.
+    viewport.gpu_profiler.clear_scopes();
+    for (uint32_t i = 0; i < ui.app_window.frames_in_flight; ++i) {
+        main_task_graphs.push_back(record_main_task_graph());
     }
-    viewport.gpu_input.Resolution = daxa_f32vec3{
-        static_cast<daxa_f32>(viewport_size.x),
-        static_cast<daxa_f32>(viewport_size.y),
-        1.0f,
-    };
-    viewport.gpu_input.ChannelResolution[0] = daxa_f32vec3{
-        static_cast<daxa_f32>(viewport_size.x),
-        static_cast<daxa_f32>(viewport_size.y),
-        1.0f,
+}
+
+auto ShaderApp::record_main_task_graph() -> daxa::TaskGraph {
+    auto get_viewport_size = [this]() {
+        if (ui.is_fullscreen) {
+            return daxa_f32vec2{
+                static_cast<daxa_f32>(ui.app_window.size.x),
+                static_cast<daxa_f32>(ui.app_window.size.y),
+            };
+        }
+        return daxa_f32vec2(ui.viewport_element->GetClientWidth(), ui.viewport_element->GetClientHeight());
     };
+    // While a resize is settling, the viewport keeps its resolution and gets stretched over the new rect.
+    if (!resize_pending) {
+        viewport.set_viewport_size(get_viewport_size());
+    }
 
     auto &app_window = ui.app_window;
 
@@ -438,61 +789,88 @@ auto ShaderApp::record_main_task_graph() -> daxa::TaskGraph {
     });
     task_graph.use_persistent_image(task_swapchain_image);
 
-    task_graph.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_swapchain_image),
-        },
-        .task = [this](daxa::TaskInterface const &ti) {
-            auto &recorder = ti.recorder;
-            auto swapchain_image = ti.get(task_swapchain_image).ids[0];
-            auto swapchain_image_full_slice = daxa_device.image_view_info(swapchain_image.default_view()).value().slice;
-            recorder.clear_image({
-                .dst_image_layout = daxa::ImageLayout::TRANSFER_DST_OPTIMAL,
-                .clear_value = std::array<daxa::f32, 4>{0.2f, 0.1f, 0.4f, 1.0f},
-                .dst_image = swapchain_image,
-                .dst_slice = swapchain_image_full_slice,
-            });
-        },
-        .name = "clear screen",
-    });
+    auto const swapchain_format = app_window.swapchain.get_format();
+    // Below full scale, the blit does the upscaling.
+    auto const render_direct = !resize_pending && viewport.dynamic_resolution.scale() == 1.0f && viewport.can_render_direct(swapchain_format);
+    auto get_viewport_pos = [this]() {
+        return daxa_f32vec2{
+            ui.viewport_element->GetAbsoluteLeft() + ui.viewport_element->GetClientLeft(),
+            ui.viewport_element->GetAbsoluteTop() + ui.viewport_element->GetClientTop(),
+        };
+    };
 
-    auto viewport_render_image = viewport.record(task_graph);
-
-    task_graph.add_task({
-        .attachments = {
-            daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_READ, daxa::ImageViewType::REGULAR_2D, viewport_render_image),
-            daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_swapchain_image),
-        },
-        .task = [viewport_render_image, viewport_size, this](daxa::TaskInterface const &ti) {
-            auto &recorder = ti.recorder;
-            auto image_size = ti.device.image_info(ti.get(viewport_render_image).ids[0]).value().size;
-            auto viewport_pos0 = daxa_f32vec2{
-                ui.viewport_element->GetAbsoluteLeft() + ui.viewport_element->GetClientLeft(),
-                ui.viewport_element->GetAbsoluteTop() + ui.viewport_element->GetClientTop(),
-            };
-            auto viewport_pos1 = daxa_f32vec2{viewport_pos0.x + viewport_size.x, viewport_pos0.y + viewport_size.y};
-            recorder.blit_image_to_image({
-                .src_image = ti.get(viewport_render_image).ids[0],
-                .src_image_layout = ti.get(viewport_render_image).layout,
-                .dst_image = ti.get(task_swapchain_image).ids[0],
-                .dst_image_layout = ti.get(task_swapchain_image).layout,
-                .src_offsets = {{{static_cast<int32_t>(viewport_pos0.x), static_cast<int32_t>(viewport_pos1.y), 0}, {static_cast<int32_t>(viewport_pos1.x), static_cast<int32_t>(viewport_pos0.y), 1}}},
-                .dst_offsets = {{{static_cast<int32_t>(viewport_pos0.x), static_cast<int32_t>(viewport_pos0.y), 0}, {static_cast<int32_t>(viewport_pos1.x), static_cast<int32_t>(viewport_pos1.y), 1}}},
-                .filter = daxa::Filter::LINEAR,
-            });
-        },
-        .name = "blit_image_to_image",
-    });
+    // In fullscreen, the viewport covers the whole swapchain image when it's rendered to directly.
+    if (!(render_direct && ui.is_fullscreen)) {
+        task_graph.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_swapchain_image),
+            },
+            .task = [this](daxa::TaskInterface const &ti) {
+                auto &recorder = ti.recorder;
+                auto swapchain_image = ti.get(task_swapchain_image).ids[0];
+                auto swapchain_image_full_slice = daxa_device.image_view_info(swapchain_image.default_view()).value().slice;
+                recorder.clear_image({
+                    .dst_image_layout = daxa::ImageLayout::TRANSFER_DST_OPTIMAL,
+                    .clear_value = std::array<daxa::f32, 4>{0.2f, 0.1f, 0.4f, 1.0f},
+                    .dst_image = swapchain_image,
+                    .dst_slice = swapchain_image_full_slice,
+                });
+            },
+            .name = "clear screen",
+        });
+    }
+
+    auto direct_target = std::optional<ViewportTarget>{};
+    if (render_direct) {
+        direct_target = ViewportTarget{
+            .image = task_swapchain_image,
+            .format = swapchain_format,
+            .get_offset = [this, get_viewport_pos]() -> daxa_i32vec2 {
+                if (ui.is_fullscreen) {
+                    return {0, 0};
+                }
+                auto const pos = get_viewport_pos();
+                return {static_cast<int32_t>(pos.x), static_cast<int32_t>(pos.y)};
+            },
+        };
+    }
+    auto viewport_render_image = viewport.record(task_graph, direct_target);
+
+    if (viewport_render_image) {
+        task_graph.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_READ, daxa::ImageViewType::REGULAR_2D, *viewport_render_image),
+                daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_WRITE, daxa::ImageViewType::REGULAR_2D, task_swapchain_image),
+            },
+            .task = viewport.gpu_profiler.wrap("blit", [viewport_render_image = *viewport_render_image, get_viewport_size, get_viewport_pos, this](daxa::TaskInterface const &ti) {
+                auto &recorder = ti.recorder;
+                auto image_size = ti.device.image_info(ti.get(viewport_render_image).ids[0]).value().size;
+                auto viewport_size = get_viewport_size();
+                auto viewport_pos0 = get_viewport_pos();
+                auto viewport_pos1 = daxa_f32vec2{viewport_pos0.x + viewport_size.x, viewport_pos0.y + viewport_size.y};
+                recorder.blit_image_to_image({
+                    .src_image = ti.get(viewport_render_image).ids[0],
+                    .src_image_layout = ti.get(viewport_render_image).layout,
+                    .dst_image = ti.get(task_swapchain_image).ids[0],
+                    .dst_image_layout = ti.get(task_swapchain_image).layout,
+                    .src_offsets = {{{0, static_cast<int32_t>(image_size.y), 0}, {static_cast<int32_t>(image_size.x), 0, 1}}},
+                    .dst_offsets = {{{static_cast<int32_t>(viewport_pos0.x), static_cast<int32_t>(viewport_pos0.y), 0}, {static_cast<int32_t>(viewport_pos1.x), static_cast<int32_t>(viewport_pos1.y), 1}}},
+                    .filter = daxa::Filter::LINEAR,
+                });
+            }),
+            .name = "blit_image_to_image",
+        });
+    }
 
     if (!ui.is_fullscreen) {
         task_graph.add_task({
             .attachments = {
                 daxa::inl_attachment(daxa::TaskImageAccess::COLOR_ATTACHMENT, daxa::ImageViewType::REGULAR_2D, task_swapchain_image),
             },
-            .task = [this](daxa::TaskInterface ti) {
+            .task = viewport.gpu_profiler.wrap("ui", [this](daxa::TaskInterface ti) {
                 auto &recorder = ti.recorder;
                 ui.render(recorder, ti.get(task_swapchain_image).ids[0]);
-            },
+            }),
             .name = "ui draw",
         });
     }
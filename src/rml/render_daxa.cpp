@@ -1,6 +1,8 @@
 #define DAXA_REMOVE_DEPRECATED 0
 
 #include <app/resources.hpp>
+#include <app/shader_compiler.hpp>
+#include <app/spirv_cache.hpp>
 
 #include <RmlUi/Core/Types.h>
 #include <daxa/daxa.inl>
@@ -67,20 +69,36 @@ daxa_f32vec4 linear_to_srgb(daxa_f32vec4 srgb) {
 )glsl";
 
 RenderInterface_Daxa::RenderInterface_Daxa(daxa::Device device, daxa::Format format) : device(std::move(device)) {
-    pipeline_manager = daxa::PipelineManager(
-        daxa::PipelineManagerInfo2{
-            .device = this->device,
+    // The UI shaders never change between runs, so they go through the SPIR-V cache instead of
+    // being recompiled at every start.
+    auto spirv_cache = SpirvCache{cache_dir / "spirv"};
+    auto compile_stage = [&](ShaderStage stage, std::string source) -> std::vector<uint32_t> {
+        auto cache_key = SpirvCacheKey{};
+        cache_key.append("rml-spirv-1");
+        cache_key.append(source);
+        if (auto cached_spirv = spirv_cache.load(cache_key)) {
+            return std::move(*cached_spirv);
+        }
+        auto result = compile_glsl({
+            .source_path = stage == ShaderStage::VERTEX ? "rml.vert.glsl" : "rml.frag.glsl",
+            .source = std::move(source),
+            .stage = stage,
             .root_paths = {
                 resource_dir / std::filesystem::path("src"),
                 DAXA_SHADER_INCLUDE_DIR,
                 "src",
             },
-            .default_language = daxa::ShaderLanguage::GLSL,
-            .name = "pipeline_manager",
+            .name = "rml pipeline",
         });
-    auto compile_result = pipeline_manager.add_raster_pipeline(daxa::RasterPipelineCompileInfo{
-        .vertex_shader_info = daxa::ShaderCompileInfo{
-            .source = daxa::ShaderCode{std::string{SHADER_COMMON} + R"glsl(
+        if (!result.error.empty()) {
+            std::cerr << "Failed to create the rml daxa raster pipeline. This should never happen, contact Gabe Rundlett. Compilation result = " << result.error << std::endl;
+            std::terminate();
+        }
+        spirv_cache.store(cache_key, result.spirv);
+        return std::move(result.spirv);
+    };
+
+    auto vertex_spirv = compile_stage(ShaderStage::VERTEX, std::string{SHADER_COMMON} + R"glsl(
                 layout(location = 0) out struct {
                     daxa_f32vec4 Color;
                     daxa_f32vec2 UV;
@@ -103,14 +121,8 @@ RenderInterface_Daxa::RenderInterface_Daxa(daxa::Device device, daxa::Format for
                     gl_Position = push.projection * vec4(aPos, 0, 1);
                     gl_Position.z += 0.5;
                 }
-            )glsl"},
-            .compile_options = {
-                .language = daxa::ShaderLanguage::GLSL,
-                .enable_debug_info = true,
-            },
-        },
-        .fragment_shader_info = daxa::ShaderCompileInfo{
-            .source = daxa::ShaderCode{std::string{SHADER_COMMON} + R"glsl(
+            )glsl");
+    auto fragment_spirv = compile_stage(ShaderStage::FRAGMENT, std::string{SHADER_COMMON} + R"glsl(
                 layout(location = 0) out daxa_f32vec4 fColor;
                 layout(location = 0) in struct {
                     daxa_f32vec4 Color;
@@ -120,11 +132,16 @@ RenderInterface_Daxa::RenderInterface_Daxa(daxa::Device device, daxa::Format for
                     vec4 tex_color = texture(daxa_sampler2D(push.texture0_id, push.sampler0_id), In.UV.st).rgba;
                     fColor = linear_to_srgb(In.Color.rgba * tex_color);
                 }
-            )glsl"},
-            .compile_options = daxa::ShaderCompileOptions{
-                .language = daxa::ShaderLanguage::GLSL,
-                .enable_debug_info = true,
-            },
+            )glsl");
+
+    raster_pipeline = std::make_shared<daxa::RasterPipeline>(this->device.create_raster_pipeline({
+        .vertex_shader_info = daxa::ShaderInfo{
+            .byte_code = vertex_spirv.data(),
+            .byte_code_size = static_cast<uint32_t>(vertex_spirv.size()),
+        },
+        .fragment_shader_info = daxa::ShaderInfo{
+            .byte_code = fragment_spirv.data(),
+            .byte_code_size = static_cast<uint32_t>(fragment_spirv.size()),
         },
         .color_attachments = {{
             .format = format,
@@ -136,14 +153,7 @@ RenderInterface_Daxa::RenderInterface_Daxa(daxa::Device device, daxa::Format for
         .raster = {},
         .push_constant_size = sizeof(Push),
         .name = "rml pipeline",
-    });
-
-    if (!compile_result.is_ok()) {
-        std::cerr << "Failed to create the rml daxa raster pipeline. This should never happen, contact Gabe Rundlett. Compilation result = " << compile_result.message() << std::endl;
-        std::terminate();
-    }
-
-    raster_pipeline = compile_result.value();
+    }));
 
     recreate_vbuffer(4096);
     recreate_ibuffer(4096);
@@ -285,6 +295,12 @@ void RenderInterface_Daxa::end_frame(daxa::ImageId target_image, daxa::CommandRe
         .src_access = daxa::AccessConsts::HOST_WRITE,
         .dst_access = daxa::AccessConsts::TRANSFER_READ,
     });
+    // The buffers are shared by all frames in flight, so the previous frame's draws have to be
+    // done reading them before they're overwritten.
+    recorder.pipeline_barrier({
+        .src_access = daxa::AccessConsts::VERTEX_SHADER_READ | daxa::AccessConsts::INDEX_INPUT_READ,
+        .dst_access = daxa::AccessConsts::TRANSFER_WRITE,
+    });
     recorder.copy_buffer_to_buffer({
         .src_buffer = staging_ibuffer,
         .dst_buffer = ibuffer,
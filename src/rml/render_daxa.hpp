@@ -2,7 +2,6 @@
 
 #include <RmlUi/Core/RenderInterface.h>
 #include <RmlUi/Core/Types.h>
-#include <daxa/utils/pipeline_manager.hpp>
 #include <daxa/command_recorder.hpp>
 #include <daxa/daxa.hpp>
 
@@ -63,7 +62,6 @@ class RenderInterface_Daxa : public Rml::RenderInterface {
     std::vector<Rml::byte> image_upload_data{};
     std::stack<size_t> draw_free_list{};
 
-    daxa::PipelineManager pipeline_manager{};
     std::shared_ptr<daxa::RasterPipeline> raster_pipeline{};
     daxa::BufferId vbuffer{};
     daxa::BufferId ibuffer{};
@@ -8,6 +8,7 @@
 #include <RmlUi/Core/Event.h>
 #include <RmlUi/Core/ID.h>
 #include <RmlUi/Core/Input.h>
+#include <RmlUi/Core/StringUtilities.h>
 #include <RmlUi/Debugger.h>
 #include <fmt/format.h>
 #include <nfd.h>
@@ -15,7 +16,10 @@
 #include <ui/app_ui.hpp>
 
 #include <daxa/command_recorder.hpp>
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
 
 namespace {
@@ -108,6 +112,223 @@ namespace {
             auto enabled = settings_window_vsync->GetAttribute("checked") == nullptr;
             AppUi::s_instance->app_window.set_vsync(enabled);
         }
+        if (value == "settings_window_spirv_optimization") {
+            auto const option = event.GetParameter<Rml::String>("value", "none");
+            auto optimization = SpirvOptimization::NONE;
+            if (option == "performance") {
+                optimization = SpirvOptimization::PERFORMANCE;
+            } else if (option == "size") {
+                optimization = SpirvOptimization::SIZE;
+            }
+            if (optimization != AppUi::s_instance->settings.spirv_optimization) {
+                AppUi::s_instance->settings.spirv_optimization = optimization;
+                AppUi::s_instance->on_spirv_optimization_change(optimization);
+            }
+        }
+        if (value == "settings_window_dynamic_resolution") {
+            auto *checkbox = settings_window_element->GetElementById("settings_window_dynamic_resolution");
+            auto &settings = AppUi::s_instance->settings;
+            settings.dynamic_resolution = checkbox->GetAttribute("checked") == nullptr;
+            AppUi::s_instance->on_dynamic_resolution_change(settings.dynamic_resolution, settings.dynamic_resolution_target_ms);
+        }
+        if (value == "settings_window_dynamic_resolution_target") {
+            auto const option = event.GetParameter<Rml::String>("value", "60");
+            auto const fps = std::clamp(std::strtod(option.c_str(), nullptr), 15.0, 360.0);
+            auto &settings = AppUi::s_instance->settings;
+            settings.dynamic_resolution_target_ms = 1000.0 / fps;
+            AppUi::s_instance->on_dynamic_resolution_change(settings.dynamic_resolution, settings.dynamic_resolution_target_ms);
+        }
+        if (value == "settings_window_background_frame_rate") {
+            auto const option = event.GetParameter<Rml::String>("value", "10");
+            AppUi::s_instance->settings.background_frame_rate = static_cast<uint32_t>(std::strtoul(option.c_str(), nullptr, 10));
+        }
+        if (value == "settings_window_frames_in_flight") {
+            auto const option = event.GetParameter<Rml::String>("value", "1");
+            auto count = std::clamp<uint32_t>(static_cast<uint32_t>(std::strtoul(option.c_str(), nullptr, 10)), 1, 3);
+            if (count != AppUi::s_instance->settings.frames_in_flight) {
+                AppUi::s_instance->settings.frames_in_flight = count;
+                AppUi::s_instance->on_frames_in_flight_change(count);
+            }
+        }
+    }
+} // namespace
+
+namespace {
+    Rml::Element *load_timings_window_element{};
+    Rml::Element *load_timings_window_content_element{};
+    Rml::Element *load_time_element{};
+    uint64_t shown_load_index{};
+    BufferMemoryStats shown_buffer_memory{};
+
+    class LoadTimingsWindowEventListener : public Rml::EventListener {
+      public:
+        void ProcessEvent(Rml::Event &event) override {
+            if (event.GetId() == Rml::EventId::Blur) {
+                load_timings_window_element->SetProperty("display", "none");
+            }
+        }
+    };
+    LoadTimingsWindowEventListener load_timings_window_event_listener;
+
+    void load_load_timings_window(Rml::ElementDocument *document) {
+        load_timings_window_element = document->GetElementById("load_timings_window");
+        load_timings_window_content_element = document->GetElementById("load_timings_window_content");
+        load_time_element = document->GetElementById("load_time");
+        load_timings_window_element->AddEventListener(Rml::EventId::Blur, &load_timings_window_event_listener);
+        // Force a refresh, the document may have been reloaded.
+        shown_load_index = 0;
+    }
+
+    void toggle_load_timings_window() {
+        auto const display_prop = load_timings_window_element->GetProperty("display")->ToString();
+        if (display_prop == "block") {
+            load_timings_window_element->SetProperty("display", "none");
+            load_timings_window_element->Blur();
+        } else {
+            load_timings_window_element->SetProperty("display", "block");
+            load_timings_window_element->Focus();
+        }
+    }
+
+    void load_timings_window_process_event(Rml::Event & /*event*/, Rml::String const &value) {
+        if (value == "load_timings_window_close") {
+            load_timings_window_element->SetProperty("display", "none");
+            load_timings_window_element->Blur();
+        }
+    }
+
+    void update_load_timings(ShaderLoadTimings const &timings, BufferMemoryStats const &buffer_memory) {
+        if (timings.load_index == shown_load_index && buffer_memory.allocated_bytes == shown_buffer_memory.allocated_bytes && buffer_memory.saved_bytes == shown_buffer_memory.saved_bytes) {
+            return;
+        }
+        shown_load_index = timings.load_index;
+        shown_buffer_memory = buffer_memory;
+
+        load_time_element->SetInnerRML(fmt::format("{}{:.0f} ms", timings.failed ? "failed, " : "", timings.total_ms));
+
+        auto cell = [](std::string const &text) { return "<span class=\"load_timings_cell\">" + text + "</span>"; };
+        auto ms = [&](double value) { return cell(fmt::format("{:.1f}", value)); };
+        auto rml = std::string{};
+        rml += "<div class=\"load_timings_row\"><span class=\"load_timings_name\">pass</span>";
+        rml += cell("textures") + cell("preprocess") + cell("parse") + cell("SPIR-V") + cell("pipeline") + cell("instrs");
+        rml += "</div>";
+        for (auto const &pass : timings.passes) {
+            // Pass names come from the project, so they're escaped before they're put into RML.
+            auto name = Rml::StringUtilities::EncodeRml(pass.name);
+            if (!pass.reachable) {
+                name += " (unused)";
+            } else if (pass.frame_invariant) {
+                name += " (static)";
+            }
+            if (pass.unused_channels != 0) {
+                name += fmt::format(" (-{} ch)", pass.unused_channels);
+            }
+            rml += "<div class=\"load_timings_row\"><span class=\"load_timings_name\">" + name + "</span>";
+            rml += ms(pass.texture_ms);
+            if (pass.reused) {
+                rml += cell("reused") + cell("") + cell("") + cell("") + cell("");
+            } else if (pass.spirv_cached) {
+                rml += ms(pass.preprocess_ms) + cell("cached") + cell("") + ms(pass.pipeline_ms) + cell(fmt::format("{}", pass.spirv_instructions));
+            } else {
+                rml += ms(pass.preprocess_ms) + ms(pass.parse_ms) + ms(pass.spirv_ms + pass.optimize_ms) + ms(pass.pipeline_ms);
+                if (pass.spirv_instructions_unoptimized != 0) {
+                    rml += cell(fmt::format("{}&gt;{}", pass.spirv_instructions_unoptimized, pass.spirv_instructions));
+                } else {
+                    rml += cell(fmt::format("{}", pass.spirv_instructions));
+                }
+            }
+            rml += "</div>";
+        }
+        rml += fmt::format("<div class=\"load_timings_row\">texture decode: {:.1f} ms</div>", timings.texture_decode_ms);
+        rml += fmt::format("<div class=\"load_timings_row\">texture upload: {:.1f} ms</div>", timings.texture_upload_ms);
+        rml += fmt::format("<div class=\"load_timings_row\">pipeline warm-up: {:.1f} ms</div>", timings.warm_up_ms);
+        auto const mib = [](uint64_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+        rml += fmt::format("<div class=\"load_timings_row\">buffer images: {:.1f} MiB ({:.1f} MiB saved on unused mips)</div>", mib(buffer_memory.allocated_bytes), mib(buffer_memory.saved_bytes));
+        load_timings_window_content_element->SetInnerRML(rml);
+    }
+} // namespace
+
+namespace {
+    Rml::Element *gpu_timings_window_element{};
+    Rml::Element *gpu_timings_window_timeline_element{};
+    Rml::Element *gpu_timings_window_content_element{};
+    // The timings change every frame, so the window is only rebuilt this often.
+    constexpr auto GPU_TIMINGS_REFRESH_INTERVAL = std::chrono::milliseconds{250};
+    std::chrono::steady_clock::time_point gpu_timings_refresh_time{};
+
+    class GpuTimingsWindowEventListener : public Rml::EventListener {
+      public:
+        void ProcessEvent(Rml::Event &event) override {
+            if (event.GetId() == Rml::EventId::Blur) {
+                gpu_timings_window_element->SetProperty("display", "none");
+            }
+        }
+    };
+    GpuTimingsWindowEventListener gpu_timings_window_event_listener;
+
+    void load_gpu_timings_window(Rml::ElementDocument *document) {
+        gpu_timings_window_element = document->GetElementById("gpu_timings_window");
+        gpu_timings_window_timeline_element = document->GetElementById("gpu_timings_window_timeline");
+        gpu_timings_window_content_element = document->GetElementById("gpu_timings_window_content");
+        gpu_timings_window_element->AddEventListener(Rml::EventId::Blur, &gpu_timings_window_event_listener);
+    }
+
+    void toggle_gpu_timings_window() {
+        auto const display_prop = gpu_timings_window_element->GetProperty("display")->ToString();
+        if (display_prop == "block") {
+            gpu_timings_window_element->SetProperty("display", "none");
+            gpu_timings_window_element->Blur();
+        } else {
+            gpu_timings_window_element->SetProperty("display", "block");
+            gpu_timings_window_element->Focus();
+            // Don't show the timings from whenever the window was last open.
+            gpu_timings_refresh_time = {};
+        }
+    }
+
+    void gpu_timings_window_process_event(Rml::Event & /*event*/, Rml::String const &value) {
+        if (value == "gpu_timings_window_close") {
+            gpu_timings_window_element->SetProperty("display", "none");
+            gpu_timings_window_element->Blur();
+        }
+    }
+
+    void update_gpu_timings(GpuProfiler const &gpu_profiler) {
+        if (gpu_timings_window_element->GetProperty("display")->ToString() != "block") {
+            return;
+        }
+        auto const now = std::chrono::steady_clock::now();
+        if (now < gpu_timings_refresh_time) {
+            return;
+        }
+        gpu_timings_refresh_time = now + GPU_TIMINGS_REFRESH_INTERVAL;
+
+        auto const timings = gpu_profiler.timings();
+
+        auto max_frame_ms = 0.0;
+        for (auto const frame_ms : timings.frame_history_ms) {
+            max_frame_ms = std::max(max_frame_ms, frame_ms);
+        }
+        auto timeline = std::string{};
+        for (size_t i = 0; i < timings.frame_history_ms.size(); ++i) {
+            auto const height = 48.0 * timings.frame_history_ms[i] / std::max(max_frame_ms, 0.001);
+            timeline += fmt::format("<div class=\"gpu_timings_frame\" style=\"left: {}dp; height: {:.1f}dp;\"></div>", i * 3, height);
+        }
+        gpu_timings_window_timeline_element->SetInnerRML(timeline);
+
+        auto cell = [](std::string const &text) { return "<span class=\"gpu_timings_cell\">" + text + "</span>"; };
+        auto ms = [&](double value) { return cell(fmt::format("{:.3f}", value)); };
+        auto rml = std::string{};
+        rml += "<div class=\"gpu_timings_row\"><span class=\"gpu_timings_name\">task</span>" + cell("avg ms") + cell("max ms") + "</div>";
+        for (auto const &scope : timings.scopes) {
+            auto const bar_width = timings.avg_frame_ms > 0.0 ? std::min(100.0, 100.0 * scope.avg_ms / timings.avg_frame_ms) : 0.0;
+            rml += "<div class=\"gpu_timings_row\"><span class=\"gpu_timings_name\">" + Rml::StringUtilities::EncodeRml(scope.name) + "</span>";
+            rml += ms(scope.avg_ms) + ms(scope.max_ms);
+            rml += fmt::format("<span class=\"gpu_timings_bar_track\"><span class=\"gpu_timings_bar\" style=\"width: {:.1f}%;\"></span></span>", bar_width);
+            rml += "</div>";
+        }
+        rml += fmt::format("<div class=\"gpu_timings_row\">frame: {:.3f} ms avg, {:.3f} ms max over {} frames</div>", timings.avg_frame_ms, max_frame_ms, timings.frame_history_ms.size());
+        gpu_timings_window_content_element->SetInnerRML(rml);
     }
 } // namespace
 
@@ -147,6 +368,10 @@ namespace {
             AppUi::s_instance->toggle_fullscreen();
         } else if (value == "bottom_bar_save") {
             AppUi::s_instance->save_json(false);
+        } else if (value == "bottom_bar_load_timings") {
+            toggle_load_timings_window();
+        } else if (value == "bottom_bar_gpu_timings") {
+            toggle_gpu_timings_window();
         }
     }
 } // namespace
@@ -204,6 +429,8 @@ namespace {
             load_download_bar(document);
             load_viewport(document);
             load_settings_window(document);
+            load_load_timings_window(document);
+            load_gpu_timings_window(document);
 
             AppUi::s_instance->buffer_panel.load(context, document);
         }
@@ -323,6 +550,10 @@ namespace {
                 AppUi::s_instance->buffer_panel.process_event(event, value);
             } else if (value.find("settings_window_") != std::string::npos) {
                 settings_window_process_event(event, value);
+            } else if (value.find("load_timings_window_") != std::string::npos) {
+                load_timings_window_process_event(event, value);
+            } else if (value.find("gpu_timings_window_") != std::string::npos) {
+                gpu_timings_window_process_event(event, value);
             }
         }
 
@@ -370,17 +601,22 @@ AppUi::~AppUi() {
     Rml::Shutdown();
 }
 
-void AppUi::update(float time, float fps) {
+void AppUi::update(float time, float fps, ShaderLoadTimings const &load_timings, BufferMemoryStats const &buffer_memory, GpuProfiler const &gpu_profiler) {
     app_window.key_down_callback = key_down_callback;
     app_window.update();
 
     update_bottom_bar(time, fps);
+    update_load_timings(load_timings, buffer_memory);
+    update_gpu_timings(gpu_profiler);
     update_download_bar();
     buffer_panel.update();
 }
 
 void AppUi::render(daxa::CommandRecorder &recorder, daxa::ImageId target_image) {
     auto resolution_str = fmt::format("{} x {}", viewport_element->GetClientWidth(), viewport_element->GetClientHeight());
+    if (render_scale < 1.0f) {
+        resolution_str += fmt::format(" ({:.1f}%)", render_scale * 100.0f);
+    }
     resolution_element->SetInnerRML(resolution_str);
 
     rml_context->Update();
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <ui/components/buffer_panel.hpp>
+#include <app/load_timings.hpp>
+#include <app/gpu_profiler.hpp>
+#include <app/shader_compiler.hpp>
 
 #include <rml/system_glfw.hpp>
 #include <rml/render_daxa.hpp>
@@ -16,6 +19,12 @@ class EventInstancer : public Rml::EventListenerInstancer {
 
 struct AppSettings {
     bool export_downloads;
+    SpirvOptimization spirv_optimization = SpirvOptimization::NONE;
+    uint32_t frames_in_flight = 1;
+    bool dynamic_resolution = false;
+    double dynamic_resolution_target_ms = 1000.0 / 60.0;
+    // Frame rate while the window is unfocused or hidden. 0 renders at the full rate.
+    uint32_t background_frame_rate = 10;
 };
 
 struct AppUi {
@@ -33,6 +42,8 @@ struct AppUi {
     bool paused{};
     bool is_fullscreen{};
     AppSettings settings{};
+    // Shown next to the viewport resolution when it's below 1.
+    float render_scale = 1.0f;
 
     Rml::String download_input{};
 
@@ -40,6 +51,9 @@ struct AppUi {
     std::function<void(bool)> on_toggle_pause{};
     std::function<void(bool)> on_toggle_fullscreen{};
     std::function<void(Rml::String const &)> on_download{};
+    std::function<void(SpirvOptimization)> on_spirv_optimization_change{};
+    std::function<void(uint32_t)> on_frames_in_flight_change{};
+    std::function<void(bool, double)> on_dynamic_resolution_change{};
 
     std::optional<std::filesystem::path> current_save_path = std::nullopt;
 
@@ -50,7 +64,7 @@ struct AppUi {
     auto operator=(const AppUi &) -> AppUi & = delete;
     auto operator=(AppUi &&) -> AppUi & = delete;
 
-    void update(float time, float fps);
+    void update(float time, float fps, ShaderLoadTimings const &load_timings, BufferMemoryStats const &buffer_memory, GpuProfiler const &gpu_profiler);
     void render(daxa::CommandRecorder &recorder, daxa::ImageId target_image);
 
     void toggle_fullscreen();
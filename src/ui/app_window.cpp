@@ -13,6 +13,8 @@
 
 #include <stb_image.h>
 
+#include <algorithm>
+
 auto get_native_handle(GLFWwindow *glfw_window_ptr) -> daxa::NativeWindowHandle {
 #if defined(_WIN32)
     return glfwGetWin32Window(glfw_window_ptr);
@@ -41,12 +43,13 @@ namespace {
 } // namespace
 
 AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
-    : glfw_window{create(size), &glfwDestroyWindow}, size{size} {
+    : glfw_window{create(size), &glfwDestroyWindow}, device{std::move(device)}, size{size} {
     glfwSetWindowUserPointer(this->glfw_window.get(), this);
     glfwSetWindowSizeCallback(
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, int width, int height) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             self.size = {width, height};
             self.swapchain.resize();
             if (self.on_resize) {
@@ -58,6 +61,7 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             if (self.on_close) {
                 self.on_close();
             }
@@ -67,6 +71,7 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, int glfw_key, int /*scancode*/, int glfw_action, int glfw_mods) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             auto *context = self.rml_context;
             if (context == nullptr) {
                 return;
@@ -115,6 +120,7 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, unsigned int codepoint) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             auto *context = self.rml_context;
             RmlGLFW::ProcessCharCallback(context, codepoint);
         });
@@ -123,6 +129,7 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, int entered) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             auto *context = self.rml_context;
             RmlGLFW::ProcessCursorEnterCallback(context, entered);
         });
@@ -132,6 +139,7 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, double xpos, double ypos) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             auto *context = self.rml_context;
             bool still_valid = RmlGLFW::ProcessCursorPosCallback(context, glfw_window, xpos, ypos, self.glfw_active_modifiers);
             if (still_valid && self.on_mouse_move) {
@@ -143,6 +151,7 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, int button, int action, int mods) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             auto *context = self.rml_context;
             self.glfw_active_modifiers = mods;
             bool still_valid = RmlGLFW::ProcessMouseButtonCallback(context, button, action, mods);
@@ -155,6 +164,7 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, double xoffset, double yoffset) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             auto *context = self.rml_context;
             bool still_valid = RmlGLFW::ProcessScrollCallback(context, yoffset, self.glfw_active_modifiers);
             if (still_valid && self.on_mouse_scroll) {
@@ -166,6 +176,7 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, int width, int height) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             auto *context = self.rml_context;
             RmlGLFW::ProcessFramebufferSizeCallback(context, width, height);
         });
@@ -174,6 +185,7 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, float xscale, float /*yscale*/) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             auto *context = self.rml_context;
             RmlGLFW::ProcessContentScaleCallback(context, xscale);
         });
@@ -182,11 +194,28 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
         this->glfw_window.get(),
         [](GLFWwindow *glfw_window, int path_count, char const *paths[]) {
             auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
             if (self.on_drop) {
                 self.on_drop(std::span<char const *>{paths, static_cast<size_t>(path_count)});
             }
         });
 
+    glfwSetWindowFocusCallback(
+        this->glfw_window.get(),
+        [](GLFWwindow *glfw_window, int focused) {
+            auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
+            self.focused = focused == GLFW_TRUE;
+        });
+
+    glfwSetWindowIconifyCallback(
+        this->glfw_window.get(),
+        [](GLFWwindow *glfw_window, int iconified) {
+            auto &self = *reinterpret_cast<AppWindow *>(glfwGetWindowUserPointer(glfw_window));
+            ++self.event_count;
+            self.minimized = iconified == GLFW_TRUE;
+        });
+
     glfwSetWindowSizeLimits(this->glfw_window.get(), 760, 215 + 240, GLFW_DONT_CARE, GLFW_DONT_CARE);
 
     auto icon_image = GLFWimage{};
@@ -194,6 +223,10 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
     glfwSetWindowIcon(this->glfw_window.get(), 1, &icon_image);
     stbi_image_free(icon_image.pixels);
 
+    create_swapchain();
+}
+
+void AppWindow::create_swapchain() {
     this->swapchain = device.create_swapchain({
         .native_window = get_native_handle(this->glfw_window.get()),
         .native_window_platform = get_native_platform(this->glfw_window.get()),
@@ -204,9 +237,9 @@ AppWindow::AppWindow(daxa::Device device, daxa_i32vec2 size)
             default: return 0;
             }
         },
-        .present_mode = daxa::PresentMode::FIFO,
+        .present_mode = present_mode,
         .image_usage = daxa::ImageUsageFlagBits::TRANSFER_DST,
-        .max_allowed_frames_in_flight = 1,
+        .max_allowed_frames_in_flight = frames_in_flight,
         .name = "AppWindowSwapchain",
     });
 }
@@ -216,6 +249,19 @@ void AppWindow::update() {
     glfwPollEvents();
 }
 
+void AppWindow::wait_events(std::optional<std::chrono::duration<double>> timeout) {
+    glfwSetWindowUserPointer(this->glfw_window.get(), this);
+    if (timeout) {
+        glfwWaitEventsTimeout(std::max(0.0, timeout->count()));
+    } else {
+        glfwWaitEvents();
+    }
+}
+
+auto AppWindow::is_visible() const -> bool {
+    return glfwGetWindowAttrib(this->glfw_window.get(), GLFW_VISIBLE) == GLFW_TRUE;
+}
+
 void AppWindow::set_fullscreen(bool is_fullscreen) {
     auto *monitor = glfwGetPrimaryMonitor();
     if (is_fullscreen) {
@@ -229,6 +275,19 @@ void AppWindow::set_fullscreen(bool is_fullscreen) {
 }
 
 void AppWindow::set_vsync(bool enabled) {
-    auto present_mode = enabled ? daxa::PresentMode::FIFO : daxa::PresentMode::IMMEDIATE;
+    present_mode = enabled ? daxa::PresentMode::FIFO : daxa::PresentMode::IMMEDIATE;
     swapchain.set_present_mode(present_mode);
 }
+
+void AppWindow::set_frames_in_flight(uint32_t count) {
+    if (count == frames_in_flight) {
+        return;
+    }
+    frames_in_flight = count;
+    // The surface can only have one swapchain at a time, so the old one has to be gone first.
+    // Everything that references it (the task graphs) must have been dropped by the caller.
+    device.wait_idle();
+    swapchain = {};
+    device.collect_garbage();
+    create_swapchain();
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <optional>
 #include <utility>
 
 #include <daxa/daxa.hpp>
@@ -10,8 +12,11 @@
 
 struct AppWindow {
     std::unique_ptr<GLFWwindow, decltype(&glfwDestroyWindow)> glfw_window{nullptr, &glfwDestroyWindow};
+    daxa::Device device{};
     daxa::Swapchain swapchain{};
     daxa_i32vec2 size{};
+    daxa::PresentMode present_mode = daxa::PresentMode::FIFO;
+    uint32_t frames_in_flight = 1;
 
     struct FullscreenCache {
         daxa_i32vec2 pos{};
@@ -21,6 +26,10 @@ struct AppWindow {
     FullscreenCache fullscreen_cache{};
 
     int glfw_active_modifiers{};
+    bool focused = true;
+    bool minimized = false;
+    // Counts input, resize and focus events, so the caller can tell whether anything happened.
+    uint64_t event_count{};
     Rml::Context *rml_context{};
 
     std::function<void()> on_resize{};
@@ -38,6 +47,15 @@ struct AppWindow {
     explicit AppWindow(daxa::Device device, daxa_i32vec2 size);
 
     void update();
+    // Like update(), but blocks until an event arrives or `timeout` passed.
+    void wait_events(std::optional<std::chrono::duration<double>> timeout = std::nullopt);
+    // GLFW doesn't report occlusion, so only hidden windows count as not visible.
+    auto is_visible() const -> bool;
     void set_fullscreen(bool is_fullscreen);
     void set_vsync(bool enabled);
+    // Recreates the swapchain. The CPU may then record up to `count` frames ahead of the GPU.
+    void set_frames_in_flight(uint32_t count);
+
+  private:
+    void create_swapchain();
 };
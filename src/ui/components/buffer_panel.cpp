@@ -153,6 +153,8 @@ namespace {
                 return;
             }
             edit_state_ptr->modified = true;
+            // The main loop may be blocked waiting for events while idle.
+            glfwPostEmptyEvent();
         }
     };
 